@@ -0,0 +1,370 @@
+//Benchmark of EventSystem against a minimal hand written observer, which is the floor for what any event
+//system can cost, and against the signal/slot library in third_party/signal_slot.hpp, running the same workloads.
+//This is a separate program from main.cpp (Benchmark.vcxproj), build it with optimizations on, for example:
+//g++ -std=c++20 -O2 -DNDEBUG Benchmark.cpp -o Benchmark -pthread
+//cl /std:c++20 /O2 /DNDEBUG /EHsc Benchmark.cpp
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include "EventSys.hpp"
+#include "third_party/signal_slot.hpp"
+
+struct BenchEvent : Event
+{
+    BenchEvent(int value_) : value{value_} {}
+    int value;
+};
+
+using BenchEventSystem = EventSystem<BenchEvent>;
+
+//written to by every handler so the optimizer cant remove the calls
+static std::uint64_t gSink {0};
+
+//The simplest observer pattern: an interface and a vector of pointers to it.
+struct HandWrittenObserver
+{
+    struct Listener
+    {
+        virtual ~Listener()=default;
+        virtual void onEvent(BenchEvent const& e)=0;
+    };
+
+    void add(Listener* listener) {mListeners.push_back(listener);}
+    void remove(Listener* listener) {std::erase(mListeners, listener);}
+
+    void notify(BenchEvent const& e) const
+    {
+        for(auto* listener : mListeners)
+            listener->onEvent(e);
+    }
+
+    void enqueue(BenchEvent e)
+    {
+        std::scoped_lock lock {mQueueMutex};
+        mQueue.push_back(e);
+    }
+
+    void dispatchQueued()
+    {
+        {
+            std::scoped_lock lock {mQueueMutex};
+            std::swap(mQueue, mDispatching);
+        }
+
+        for(auto const& e : mDispatching)
+            notify(e);
+
+        mDispatching.clear();
+    }
+
+private:
+    std::vector<Listener*> mListeners;
+    std::mutex mQueueMutex;
+    std::vector<BenchEvent> mQueue;
+    std::vector<BenchEvent> mDispatching;
+};
+
+struct SinkListener : HandWrittenObserver::Listener
+{
+    void onEvent(BenchEvent const& e) override {gSink += static_cast<std::uint64_t>(e.value);}
+};
+
+using BenchSignal = signal_slot::signal<void(BenchEvent const&)>;
+
+//signal_slot has no queue of its own, this is the same one the observer uses.
+struct QueuedBenchSignal
+{
+    void enqueue(BenchEvent e)
+    {
+        std::scoped_lock lock {queueMutex};
+        queue.push_back(e);
+    }
+
+    void dispatchQueued()
+    {
+        {
+            std::scoped_lock lock {queueMutex};
+            std::swap(queue, dispatching);
+        }
+
+        for(auto const& e : dispatching)
+            signal(e);
+
+        dispatching.clear();
+    }
+
+    BenchSignal signal;
+    std::mutex queueMutex;
+    std::vector<BenchEvent> queue;
+    std::vector<BenchEvent> dispatching;
+};
+
+//Run work iterations times and return the average nanoseconds per iteration.
+template <typename Work>
+double nanosPerIteration(std::size_t iterations, Work&& work)
+{
+    auto const start { std::chrono::steady_clock::now() };
+
+    for(std::size_t i{0}; i < iterations; ++i)
+        work(i);
+
+    std::chrono::duration<double, std::nano> const elapsed { std::chrono::steady_clock::now() - start };
+    return elapsed.count() / static_cast<double>(iterations);
+}
+
+//Run work repetitions times and return the median of how many nanoseconds one run took,
+//for workloads that are too long to average many runs of but too short to trust one.
+template <typename Work>
+double medianNanos(std::size_t repetitions, Work&& work)
+{
+    std::vector<double> runs;
+    for(std::size_t i{0}; i < repetitions; ++i)
+        runs.push_back(nanosPerIteration(1, work));
+
+    std::ranges::nth_element(runs, runs.begin() + static_cast<std::ptrdiff_t>(runs.size() / 2));
+    return runs[runs.size() / 2];
+}
+
+void printRow(std::string const& workload, double eventSys, double observer, double signal)
+{
+    std::cout << std::left << std::setw(34) << workload << std::right << std::fixed << std::setprecision(1)
+        << std::setw(14) << eventSys << std::setw(14) << observer << std::setw(14) << signal
+        << std::setw(10) << std::setprecision(2) << eventSys / observer << "x"
+        << std::setw(10) << eventSys / signal << "x\n";
+}
+
+//Publish one event to subscriberCount subscribers.
+void benchPublish(std::size_t subscriberCount)
+{
+    std::size_t const iterations { std::max<std::size_t>(1'000'000 / subscriberCount, 100) };
+
+    BenchEventSystem eventSys;
+    std::vector<SubscriptionID> IDs;
+    for(std::size_t i{0}; i < subscriberCount; ++i)
+    {
+        IDs.push_back(eventSys.getSubscriber().sub<BenchEvent>([](Event const& e)
+        {
+            gSink += static_cast<std::uint64_t>(e.unpack<BenchEvent>().value);
+        }));
+    }
+
+    auto const& publisher { eventSys.getPublisher() };
+    double const eventSysTime { nanosPerIteration(iterations, [&](std::size_t i)
+    {
+        BenchEvent e {static_cast<int>(i)};
+        publisher.pub(e);
+    })};
+
+    HandWrittenObserver observer;
+    std::vector<SinkListener> listeners(subscriberCount);
+    for(auto& listener : listeners)
+        observer.add(&listener);
+
+    double const observerTime { nanosPerIteration(iterations, [&](std::size_t i)
+    {
+        observer.notify(BenchEvent{static_cast<int>(i)});
+    })};
+
+    BenchSignal signal;
+    for(std::size_t i{0}; i < subscriberCount; ++i)
+        signal.connect([](BenchEvent const& e){ gSink += static_cast<std::uint64_t>(e.value); });
+
+    double const signalTime { nanosPerIteration(iterations, [&](std::size_t i)
+    {
+        signal(BenchEvent{static_cast<int>(i)});
+    })};
+
+    printRow("pub, " + std::to_string(subscriberCount) + " subscribers", eventSysTime, observerTime, signalTime);
+}
+
+//Subscribe subscriberCount callbacks then unsubscribe them all in a random order.
+//Reported time is per sub+unsub pair, from the median of several runs.
+void benchChurn(std::size_t subscriberCount)
+{
+    constexpr std::size_t repetitions {11};
+
+    std::vector<std::size_t> removalOrder(subscriberCount);
+    for(std::size_t i{0}; i < subscriberCount; ++i)
+        removalOrder[i] = i;
+
+    std::shuffle(removalOrder.begin(), removalOrder.end(), std::mt19937{42});
+
+    auto const sinkCallback { [](Event const& e){ gSink += static_cast<std::uint64_t>(e.unpack<BenchEvent>().value); } };
+
+    BenchEventSystem eventSys;
+    std::vector<SubscriptionID> IDs(subscriberCount);
+    double const eventSysTime { medianNanos(repetitions, [&](std::size_t)
+    {
+        auto& subscriber { eventSys.getSubscriber() };
+        for(auto& ID : IDs)
+            ID = subscriber.sub<BenchEvent>(sinkCallback);
+
+        for(auto i : removalOrder)
+            subscriber.unsub<BenchEvent>(IDs[i]);
+    })};
+
+    HandWrittenObserver observer;
+    std::vector<SinkListener> listeners(subscriberCount);
+    double const observerTime { medianNanos(repetitions, [&](std::size_t)
+    {
+        for(auto& listener : listeners)
+            observer.add(&listener);
+
+        for(auto i : removalOrder)
+            observer.remove(&listeners[i]);
+    })};
+
+    BenchSignal signal;
+    std::vector<signal_slot::connection> connections(subscriberCount);
+    double const signalTime { medianNanos(repetitions, [&](std::size_t)
+    {
+        for(auto& connection : connections)
+            connection = signal.connect([](BenchEvent const& e){ gSink += static_cast<std::uint64_t>(e.value); });
+
+        for(auto i : removalOrder)
+            connections[i].disconnect();
+    })};
+
+    auto const perPair { static_cast<double>(subscriberCount) };
+    printRow("sub/unsub churn, " + std::to_string(subscriberCount) + " subscribers", 
+        eventSysTime / perPair, observerTime / perPair, signalTime / perPair);
+}
+
+//Enqueue eventCount events then dispatch them all, with 10 subscribers. Reported time is per event.
+void benchQueued(std::size_t eventCount)
+{
+    constexpr std::size_t subscriberCount {10};
+    constexpr std::size_t rounds {20};
+
+    BenchEventSystem eventSys;
+    std::vector<SubscriptionID> IDs;
+    for(std::size_t i{0}; i < subscriberCount; ++i)
+    {
+        IDs.push_back(eventSys.getSubscriber().sub<BenchEvent>([](Event const& e)
+        {
+            gSink += static_cast<std::uint64_t>(e.unpack<BenchEvent>().value);
+        }));
+    }
+
+    double const eventSysTime { nanosPerIteration(rounds, [&](std::size_t)
+    {
+        for(std::size_t i{0}; i < eventCount; ++i)
+            eventSys.getPublisher().enqueue(BenchEvent{static_cast<int>(i)});
+
+        eventSys.dispatchQueued();
+    })};
+
+    HandWrittenObserver observer;
+    std::vector<SinkListener> listeners(subscriberCount);
+    for(auto& listener : listeners)
+        observer.add(&listener);
+
+    double const observerTime { nanosPerIteration(rounds, [&](std::size_t)
+    {
+        for(std::size_t i{0}; i < eventCount; ++i)
+            observer.enqueue(BenchEvent{static_cast<int>(i)});
+
+        observer.dispatchQueued();
+    })};
+
+    QueuedBenchSignal queuedSignal;
+    for(std::size_t i{0}; i < subscriberCount; ++i)
+        queuedSignal.signal.connect([](BenchEvent const& e){ gSink += static_cast<std::uint64_t>(e.value); });
+
+    double const signalTime { nanosPerIteration(rounds, [&](std::size_t)
+    {
+        for(std::size_t i{0}; i < eventCount; ++i)
+            queuedSignal.enqueue(BenchEvent{static_cast<int>(i)});
+
+        queuedSignal.dispatchQueued();
+    })};
+
+    auto const perEvent { static_cast<double>(eventCount) };
+    printRow("queued dispatch, " + std::to_string(eventCount) + " events", 
+        eventSysTime / perEvent, observerTime / perEvent, signalTime / perEvent);
+}
+
+//Throughput of ShardedDispatcher with 1 to N workers, with handlers that do a little work per event
+//so that there is something to parallelize. Events are spread over 1024 keys.
+void benchShardedScaling()
+{
+    constexpr std::size_t eventCount {200'000};
+    std::atomic<std::uint64_t> sink {0};
+
+    BenchEventSystem eventSys;
+    auto const ID { eventSys.getSubscriber().sub<BenchEvent>([&sink](Event const& e)
+    {
+        auto x { static_cast<std::uint64_t>(e.unpack<BenchEvent>().value) };
+        for(int i{0}; i < 200; ++i)
+            x = x * 6364136223846793005ull + 1442695040888963407ull;
+
+        sink.fetch_add(x & 1, std::memory_order_relaxed);
+    })};
+
+    std::cout << "\nShardedDispatcher scaling, " << eventCount << " events\n" << std::left << std::setw(10) << "workers"
+        << std::right << std::setw(16) << "events/sec" << std::setw(10) << "speedup\n";
+
+    double singleWorkerRate {0.0};
+    std::size_t const maxWorkers { std::max(1u, std::thread::hardware_concurrency()) };
+
+    for(std::size_t workerCount{1}; workerCount <= maxWorkers; workerCount *= 2)
+    {
+        ShardedDispatcher<BenchEvent, BenchEventSystem> dispatcher
+        {
+            eventSys.getPublisher(), workerCount, [](BenchEvent const& e){ return static_cast<std::size_t>(e.value) % 1024; }
+        };
+
+        auto const start { std::chrono::steady_clock::now() };
+
+        for(std::size_t i{0}; i < eventCount; ++i)
+            dispatcher.enqueue(BenchEvent{static_cast<int>(i)});
+
+        dispatcher.flush();
+
+        std::chrono::duration<double> const elapsed { std::chrono::steady_clock::now() - start };
+        double const rate { static_cast<double>(eventCount) / elapsed.count() };
+
+        if(workerCount == 1)
+            singleWorkerRate = rate;
+
+        std::cout << std::left << std::setw(10) << workerCount << std::right << std::fixed << std::setprecision(0) 
+            << std::setw(16) << rate << std::setw(9) << std::setprecision(2) << rate / singleWorkerRate << "x\n";
+    }
+
+    gSink += sink;
+    (void)ID;
+}
+
+int main()
+{
+#ifndef NDEBUG
+    std::cout << "warning: this is not an optimized build, the numbers will not mean much\n\n";
+#endif
+
+    std::cout << "all times in nanoseconds\n" << std::left << std::setw(34) << "workload" << std::right
+        << std::setw(14) << "EventSystem" << std::setw(14) << "observer" << std::setw(14) << "signal/slot"
+        << std::setw(11) << "vs obs" << std::setw(11) << "vs sig" << '\n';
+
+    for(std::size_t subscriberCount : {1, 10, 100, 1'000, 10'000})
+        benchPublish(subscriberCount);
+
+    for(std::size_t subscriberCount : {10, 100, 1'000, 10'000})
+        benchChurn(subscriberCount);
+
+    std::cout << "  (churn: unsub is an O(n) vector erase in all three, EventSystem's is slower\n"
+        << "   because it shifts whole subscriptions where the others shift pointers)\n";
+
+    for(std::size_t eventCount : {100, 10'000})
+        benchQueued(eventCount);
+
+    benchShardedScaling();
+
+    std::cout << "\n(sink " << gSink << ")\n";
+}
@@ -0,0 +1,430 @@
+#pragma once
+#include "EventSys.hpp"
+#include "FileIO.hpp"
+#include <cstring> //std::memcpy
+#include <string>
+#include <cstdio> //std::snprintf
+#include <exception> //std::exception_ptr
+
+//Specialize this for every event type an EventLog stores, with
+//    static void write(EventType const& e, std::vector<std::byte>& out); //append the bytes of e to out
+//    static EventType read(std::span<std::byte const> bytes);           //rebuild what write appended
+//
+//template <> struct EventSerializer<PlayerMoved>
+//{
+//    static void write(PlayerMoved const& e, std::vector<std::byte>& out) { appendBytes(out, e.position); }
+//    static PlayerMoved read(std::span<std::byte const> bytes) { return PlayerMoved{readBytes<Vec3>(bytes)}; }
+//};
+template <typename EventType>
+struct EventSerializer;
+
+//Helpers for writing EventSerializer specializations of events made of trivially copyable fields.
+template <typename T>
+requires std::is_trivially_copyable_v<T>
+void appendBytes(std::vector<std::byte>& out, T const& value)
+{
+    auto const bytes { std::as_bytes(std::span{&value, 1}) };
+    out.insert(out.end(), bytes.begin(), bytes.end());
+}
+
+//Reads a T from the front of bytes and drops it from bytes.
+template <typename T>
+requires std::is_trivially_copyable_v<T>
+T readBytes(std::span<std::byte const>& bytes)
+{
+    assert(bytes.size() >= sizeof(T));
+
+    T value;
+    std::memcpy(&value, bytes.data(), sizeof(T));
+    bytes = bytes.subspan(sizeof(T));
+
+    return value;
+}
+
+struct EventLogOptions
+{
+    //start a new segment file once the current one is this big
+    std::uint64_t segmentSize {64ull * 1024 * 1024};
+
+    //how long the writer waits for more events to share an fsync with. Publishing never waits for the disk,
+    //and an event is durable at most this long (plus the time of the write) after it was published.
+    std::chrono::milliseconds commitInterval {2};
+};
+
+//Makes the events of LoggedTs published through eventSys durable, so they can be replayed into a fresh
+//EventSystem after a restart or a crash (event sourcing).
+//Every published event of those types is serialized with EventSerializer into an in-memory buffer, and
+//a background thread appends the buffer to the current segment file of directory and fsyncs it, so one
+//fsync covers everything published in the meantime. Segments are numbered, and a new one is started when
+//the current one gets big or a snapshot is taken.
+//
+//On startup call replay before publishing anything, it maps the segments in order and publishes every
+//event in them again through getPublisher().pub (without logging them a second time). Call snapshot now
+//and then with the state the events have been building up, so old segments can be deleted and replay
+//only has to go through what was logged since.
+//
+//The logged types have to be published from one thread, the one that calls snapshot (asserted in debug builds).
+//
+//Records are stored in the byte order of the machine. A torn record at the end of a segment (from a crash
+//in the middle of a write) fails its checksum and is skipped by replay.
+template <typename EventSys, typename... LoggedTs>
+class EventLog
+{
+public:
+    static_assert(sizeof...(LoggedTs) > 0, "EventLog needs at least one event type to log.");
+
+    EventLog(EventSys& eventSys, std::filesystem::path directory, EventLogOptions options = {})
+        : mEventSys{eventSys}, mDirectory{std::move(directory)}, mOptions{options}
+    {
+        std::filesystem::create_directories(mDirectory);
+
+        //never append to a segment of an earlier run, its end could be torn
+        for(auto const& file : std::filesystem::directory_iterator{mDirectory})
+        {
+            //a snapshot that was being written when the process died
+            if(file.path().extension() == TEMPORARY_EXTENSION)
+                std::filesystem::remove(file.path());
+
+            if(auto const number { segmentNumberOf(file.path(), SEGMENT_EXTENSION) }; number >= mNextSegmentNumber)
+                mNextSegmentNumber = number + 1;
+
+            if(auto const number { segmentNumberOf(file.path(), SNAPSHOT_EXTENSION) }; number >= mNextSegmentNumber)
+                mNextSegmentNumber = number;
+        }
+
+        mSubscriptionIDs = {subscribe<LoggedTs>()...};
+        mWriter = std::jthread{[this]{ runWriter(); }};
+    }
+
+    //Everything that was logged is made durable before this returns.
+    ~EventLog()
+    {
+        [this]<std::size_t... Is>(std::index_sequence<Is...>)
+        {
+            (mEventSys.getSubscriber().template unsub<LoggedTs>(mSubscriptionIDs[Is]), ...);
+        }(std::index_sequence_for<LoggedTs...>{});
+
+        {
+            std::scoped_lock lock {mMutex};
+            mIsStopping = true;
+        }
+
+        mWakeUp.notify_one();
+        mWriter.join();
+    }
+
+    EventLog(EventLog const&)=delete;
+    EventLog& operator=(EventLog const&)=delete;
+
+    //Publish everything in the log again, oldest first, on the calling thread. If a snapshot was taken,
+    //loadSnapshot is first given the bytes saved by the latest one, and only what was logged after it is replayed.
+    //Call this once at startup, before anything else publishes the logged types. Returns how many events were replayed.
+    std::size_t replay(std::function<void(std::span<std::byte const>)> const& loadSnapshot = {})
+    {
+        std::vector<std::uint64_t> segmentNumbers;
+        std::uint64_t snapshotNumber {0};
+
+        for(auto const& file : std::filesystem::directory_iterator{mDirectory})
+        {
+            if(auto const number { segmentNumberOf(file.path(), SEGMENT_EXTENSION) }; number != 0)
+                segmentNumbers.push_back(number);
+
+            snapshotNumber = std::max(snapshotNumber, segmentNumberOf(file.path(), SNAPSHOT_EXTENSION));
+        }
+
+        if(snapshotNumber != 0)
+        {
+            assert(loadSnapshot && "this log has a snapshot, replay needs a loadSnapshot to restore it");
+
+            MappedFile const snapshot {pathOf(snapshotNumber, SNAPSHOT_EXTENSION)};
+            loadSnapshot(snapshot.bytes());
+        }
+
+        std::ranges::sort(segmentNumbers);
+
+        mReplayingThread = std::this_thread::get_id();
+        std::size_t replayedCount {0};
+
+        for(auto const number : segmentNumbers)
+        {
+            //segments from before the snapshot are already part of it
+            if(number < snapshotNumber)
+                continue;
+
+            MappedFile const segment {pathOf(number, SEGMENT_EXTENSION)};
+            replayedCount += replaySegment(segment.bytes());
+        }
+
+        mReplayingThread = std::thread::id{};
+        return replayedCount;
+    }
+
+    //Block until every event logged before this call is on disk.
+    //If the writer failed to write or fsync, this (and snapshot) throws the std::system_error it got,
+    //and nothing more is logged.
+    void sync()
+    {
+        std::unique_lock lock {mMutex};
+        waitUntilDurable(lock);
+    }
+
+    //Save the state built from the logged events so far and delete the segments it makes unnecessary.
+    //saveState appends the serialized state to the vector it is given, and is what replay hands to loadSnapshot.
+    //Call this on the thread that publishes the logged types, between publishes, so the state matches
+    //the log exactly.
+    void snapshot(std::function<void(std::vector<std::byte>&)> const& saveState)
+    {
+        assertOnPublishingThread();
+
+        std::unique_lock lock {mMutex};
+        waitUntilDurable(lock);
+
+        //the writer is idle and stays idle while the lock is held, so the segments can be switched under it.
+        //everything logged from now on goes to a new segment that replay starts from, after the snapshot.
+        mSegment.close();
+        auto const snapshotNumber { mNextSegmentNumber++ };
+
+        std::vector<std::byte> state;
+        saveState(state);
+
+        auto const temporaryPath { pathOf(snapshotNumber, TEMPORARY_EXTENSION) };
+        {
+            AppendOnlyFile file {temporaryPath};
+            file.append(state);
+            file.sync();
+        }
+
+        std::filesystem::rename(temporaryPath, pathOf(snapshotNumber, SNAPSHOT_EXTENSION));
+        syncDirectory(mDirectory);
+
+        //only now that the snapshot is durable can what it replaces go
+        for(auto const& file : std::filesystem::directory_iterator{mDirectory})
+        {
+            auto const segmentNumber { segmentNumberOf(file.path(), SEGMENT_EXTENSION) };
+            auto const oldSnapshotNumber { segmentNumberOf(file.path(), SNAPSHOT_EXTENSION) };
+
+            if((segmentNumber != 0 && segmentNumber < snapshotNumber) || (oldSnapshotNumber != 0 && oldSnapshotNumber < snapshotNumber))
+                std::filesystem::remove(file.path());
+        }
+    }
+
+    //The number of events logged since this EventLog was made (not counting replay) and how many of them are durable.
+    std::uint64_t loggedCount() const {std::scoped_lock lock {mMutex}; return mLoggedCount;}
+    std::uint64_t durableCount() const {std::scoped_lock lock {mMutex}; return mDurableCount;}
+
+private:
+    struct RecordHeader
+    {
+        std::uint32_t payloadSize;
+        std::uint32_t typeIndex; //of the event type in LoggedTs
+        std::uint32_t checksum;  //of the payload
+    };
+
+    static constexpr char const* SEGMENT_EXTENSION {".log"};
+    static constexpr char const* SNAPSHOT_EXTENSION {".snapshot"};
+    static constexpr char const* TEMPORARY_EXTENSION {".tmp"};
+
+    //FNV-1a. Only has to catch torn and zeroed records, not tampering
+    static std::uint32_t checksumOf(std::span<std::byte const> bytes)
+    {
+        std::uint32_t hash {2166136261u};
+
+        for(auto const byte : bytes)
+            hash = (hash ^ static_cast<std::uint32_t>(byte)) * 16777619u;
+
+        return hash;
+    }
+
+    std::filesystem::path pathOf(std::uint64_t number, char const* extension) const
+    {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%020llu", static_cast<unsigned long long>(number));
+        return mDirectory / (std::string{name} + extension);
+    }
+
+    //0 if path is not a file named like pathOf makes them with extension
+    static std::uint64_t segmentNumberOf(std::filesystem::path const& path, char const* extension)
+    {
+        auto const stem { path.stem().string() };
+
+        if(path.extension() != extension || stem.size() != 20 || !std::ranges::all_of(stem, [](char c){ return c >= '0' && c <= '9'; }))
+            return 0;
+
+        return std::stoull(stem);
+    }
+
+    template <typename EventType>
+    SubscriptionID subscribe()
+    {
+        return mEventSys.getSubscriber().template sub<EventType>([this](Event const& e)
+        {
+            append(e.template unpack<EventType>());
+        });
+    }
+
+    template <typename EventType>
+    void append(EventType const& e)
+    {
+        if(mReplayingThread == std::this_thread::get_id())
+            return;
+
+        assertOnPublishingThread();
+
+        bool wasIdle;
+        {
+            std::scoped_lock lock {mMutex};
+
+            if(mWriteError)
+                return;
+
+            auto const headerOffset { mPending.size() };
+            mPending.resize(headerOffset + sizeof(RecordHeader));
+            EventSerializer<EventType>::write(e, mPending);
+
+            auto const payload { std::span{mPending}.subspan(headerOffset + sizeof(RecordHeader)) };
+            RecordHeader const header
+            {
+                static_cast<std::uint32_t>(payload.size()),
+                static_cast<std::uint32_t>(IndexInPack<EventType, LoggedTs...>),
+                checksumOf(payload)
+            };
+            std::memcpy(mPending.data() + headerOffset, &header, sizeof(header));
+
+            wasIdle = mPendingCount++ == 0;
+            ++mLoggedCount;
+        }
+
+        if(wasIdle)
+            mWakeUp.notify_one();
+    }
+
+    //waitUntilDurable lets go of the lock, so snapshot only finds the writer idle afterwards if nothing was logged
+    //in the meantime, and it closes mSegment under the writer. The first thread to log or snapshot is the only one allowed to.
+    void assertOnPublishingThread()
+    {
+#ifndef NDEBUG
+        auto const thisThread { std::this_thread::get_id() };
+        std::thread::id publishingThread {};
+        mPublishingThread.compare_exchange_strong(publishingThread, thisThread);
+        assert((publishingThread == std::thread::id{} || publishingThread == thisThread) 
+            && "the logged types are published (or snapshot is called) from more than one thread");
+#endif
+    }
+
+    std::size_t replaySegment(std::span<std::byte const> bytes)
+    {
+        static constexpr std::array replayers { &EventLog::replayRecord<LoggedTs>... };
+
+        std::size_t replayedCount {0};
+
+        while(bytes.size() >= sizeof(RecordHeader))
+        {
+            RecordHeader header;
+            std::memcpy(&header, bytes.data(), sizeof(header));
+            bytes = bytes.subspan(sizeof(header));
+
+            if(header.payloadSize > bytes.size() || header.typeIndex >= replayers.size())
+                break;
+
+            auto const payload { bytes.first(header.payloadSize) };
+            if(checksumOf(payload) != header.checksum)
+                break;
+
+            (this->*replayers[header.typeIndex])(payload);
+            bytes = bytes.subspan(header.payloadSize);
+            ++replayedCount;
+        }
+
+        return replayedCount;
+    }
+
+    template <typename EventType>
+    void replayRecord(std::span<std::byte const> payload)
+    {
+        auto e { EventSerializer<EventType>::read(payload) };
+        mEventSys.getPublisher().pub(e);
+    }
+
+    void runWriter()
+    {
+        std::unique_lock lock {mMutex};
+
+        for(;;)
+        {
+            mWakeUp.wait(lock, [this]{ return mPendingCount > 0 || mIsStopping; });
+
+            if(mPendingCount == 0)
+                return;
+
+            //let more events join this commit, unless someone is waiting for it
+            mWakeUp.wait_for(lock, mOptions.commitInterval, [this]{ return mSyncWaiterCount > 0 || mIsStopping; });
+
+            std::swap(mPending, mWriting);
+            auto const writingCount { std::exchange(mPendingCount, 0) };
+            lock.unlock();
+
+            try
+            {
+                if(!mSegment.isOpen() || mSegment.size() >= mOptions.segmentSize)
+                {
+                    mSegment = AppendOnlyFile{pathOf(mNextSegmentNumber++, SEGMENT_EXTENSION)};
+                    syncDirectory(mDirectory);
+                }
+
+                mSegment.append(mWriting);
+                mSegment.sync();
+                mWriting.clear();
+            }
+            catch(std::system_error const&)
+            {
+                lock.lock();
+                mWriteError = std::current_exception();
+                mDurable.notify_all();
+                return;
+            }
+
+            lock.lock();
+            mDurableCount += writingCount;
+            mDurable.notify_all();
+        }
+    }
+
+    void waitUntilDurable(std::unique_lock<std::mutex>& lock)
+    {
+        auto const target { mLoggedCount };
+
+        ++mSyncWaiterCount;
+        mWakeUp.notify_one();
+        mDurable.wait(lock, [&]{ return mDurableCount >= target || mWriteError; });
+        --mSyncWaiterCount;
+
+        if(mWriteError)
+            std::rethrow_exception(mWriteError);
+    }
+
+    EventSys& mEventSys;
+    std::filesystem::path mDirectory;
+    EventLogOptions mOptions;
+
+    std::array<SubscriptionID, sizeof...(LoggedTs)> mSubscriptionIDs {};
+    std::atomic<std::thread::id> mReplayingThread;
+    std::atomic<std::thread::id> mPublishingThread;
+
+    mutable std::mutex mMutex;
+    std::condition_variable mWakeUp;
+    std::condition_variable mDurable;
+    std::vector<std::byte> mPending;
+    std::size_t mPendingCount {0};
+    std::uint64_t mLoggedCount {0};
+    std::uint64_t mDurableCount {0};
+    std::size_t mSyncWaiterCount {0};
+    bool mIsStopping {false};
+    std::exception_ptr mWriteError;
+
+    //only touched by the writer, or by snapshot while the writer is idle
+    std::vector<std::byte> mWriting;
+    AppendOnlyFile mSegment;
+    std::uint64_t mNextSegmentNumber {1};
+
+    std::jthread mWriter; //last so the thread is joined before anything else is destroyed
+};
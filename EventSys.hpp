@@ -2,10 +2,37 @@
 #include <functional> //std::function
 #include <unordered_map>
 #include <typeindex>
-#include <utility> //std::move
+#include <utility> //std::move, std::forward
 #include <cstdint> //uint32_t
 #include <cassert> 
 #include <ranges> //std::views::values
+#include <vector>
+#include <type_traits>
+#include <algorithm> //std::ranges::find
+#include <tuple>
+#include <array>
+#include <memory> //std::unique_ptr
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <deque>
+#include <bit> //std::countr_zero
+#include <chrono>
+#include <optional>
+#include <span>
+#include <cstddef> //std::byte
+#include <cstring> //std::memcpy
+
+#ifndef _WIN32
+    #include <unistd.h> //write, read, pipe
+    #include <fcntl.h>
+    #include <cerrno>
+    #ifdef __linux__
+        #include <sys/eventfd.h>
+    #endif
+#endif
 
 struct Event 
 {
@@ -14,7 +41,7 @@ struct Event
     auto const& unpack() const
     {
 #ifdef NDEBUG
-        return static_cast<EventType const&>(e);
+        return static_cast<EventType const&>(*this);
 #else
         EventType const* downCastPtr { dynamic_cast<EventType const*>(this) };
         assert(downCastPtr && "trying to do an invalid downcast");
@@ -29,6 +56,47 @@ protected:
 template <typename T, typename... Types>
 concept IsTypeInPack = (std::is_same_v<T, Types> || ...);
 
+//Specialize this as std::true_type for event types that should not exist in a given build
+//(editor only or debug only events for example). Publishing a compiled out event type is a no-op
+//that the optimizer removes entirely, subscribing to one stores nothing, and the EventSystem keeps no state for it.
+//
+//#ifndef EDITOR_BUILD
+//template <> struct CompileOutEvent<EditorSelectionChanged> : std::true_type {};
+//#endif
+template <typename EventType>
+struct CompileOutEvent : std::false_type {};
+
+template <typename EventType>
+concept IsCompiledOutEvent = CompileOutEvent<EventType>::value;
+
+//A set of up to 64 user defined event categories (input, network, ...), one bit each. See Subscriber::subCategory.
+using EventCategoryMask = std::uint64_t;
+
+//The categories an event type is in, declared on the type as
+//
+//struct KeyPressed : Event { static constexpr EventCategoryMask category { INPUT_EVENTS }; ... };
+//
+//Types that dont declare one are in no category.
+template <typename EventType>
+inline constexpr EventCategoryMask CategoryOf = []
+{
+    if constexpr(requires { EventType::category; })
+        return static_cast<EventCategoryMask>(EventType::category);
+    else
+        return EventCategoryMask{0};
+}();
+
+//The position of T in Types. T must be in Types.
+template <typename T, typename... Types>
+requires IsTypeInPack<T, Types...>
+inline constexpr std::size_t IndexInPack = []
+{
+    constexpr bool matches[] { std::is_same_v<T, Types>... };
+    std::size_t i {0};
+    while(!matches[i]) { ++i; }
+    return i;
+}();
+
 using SubscriptionID  = std::size_t;
 
 //an invalid sub ID used to represent a subscription ID that is not associated with any subscriptions.
@@ -36,200 +104,4059 @@ inline constexpr SubscriptionID INVALID_SUBSCRIPTION_ID { 0 };
 
 using OnEventCallback = std::function<void(Event const&)>;
 
-//Using this SubscriptionManager is optional, you can use the EventSystem without it.
-//Enum should be an enum type that you associate with a particular subscription.
-//You can subscribe to the same type multiple times as long as the enum value differs for each one.
-//EventSystemSubscriber should be EventSystem::Subscriber.
-template <typename Enum, typename EventSystemSubscriber>
-requires std::is_enum_v<Enum>
-class SubscriptionManager
+//Called for every event published through an EventSystem it is set on, see EventSystem::setPublishHook.
+//typeIndex is the position of the event type in the EventSystem's EventTs and payload is the bytes of the 
+//event after its Event base. It is a plain function pointer so an EventSystem without one pays only a null check.
+using PublishHook = void(*)(void* context, std::uint32_t typeIndex, std::span<std::byte const> payload);
+
+//The call count of a subscription made with Subscriber::sub, as opposed to subOnce/subN.
+inline constexpr std::uint32_t UNLIMITED_CALLS { UINT32_MAX };
+
+//Identifies one request made with EventSystem::Publisher::request so its reply can be routed back.
+using CorrelationID = std::uint32_t;
+inline constexpr CorrelationID INVALID_CORRELATION_ID { 0 };
+
+//The most requests that can be waiting for a reply at once, per EventSystem.
+inline constexpr std::size_t MAX_PENDING_REQUESTS { 256 };
+
+//The most events that can be waiting to be dispatched after being published from signal handlers, per EventSystem.
+inline constexpr std::size_t SIGNAL_QUEUE_CAPACITY { 64 };
+
+//The largest payload that Publisher::pubFromSignal can carry.
+inline constexpr std::size_t MAX_SIGNAL_PAYLOAD_SIZE { 32 };
+
+//Event types used as the request in EventSystem::Publisher::request must inherit from RequestEvent instead of Event.
+//The responder passes correlationID to Publisher::reply so the reply finds its way back to the requester.
+struct RequestEvent : Event
+{
+    CorrelationID correlationID {INVALID_CORRELATION_ID};
+};
+
+//Derived state (counts per key, latest value per entity, top N, ...) that the EventSystem keeps up to date
+//in place as events are published, instead of every user writing their own handler to do it.
+//Attach one with EventSystem::Subscriber::project. Folds run on the publishing thread under a
+//write lock, and any other thread can read a consistent view of the state at the same time.
+template <typename State>
+class Projection
 {
 public:
-    SubscriptionManager(EventSystemSubscriber& subscriber) : mSubscriber{subscriber} {};
+    explicit Projection(State initialState = {}) : mState{std::move(initialState)} {}
 
-    ~SubscriptionManager()
+    //A copy of the current state.
+    State snapshot() const
     {
-        ubsubFromAll();
+        std::shared_lock lock {mMutex};
+        return mState;
     }
 
-    //Returns false if subscriptionTag is already associated with a subscription.
-    //This could be the case if you accidentally call this function twice with the same enum or
-    //if you accidentally map two different enums to the same integer value... dont do this.
-    template <typename EventType>
-    bool sub(Enum subscriptionTag, OnEventCallback callback)
+    //Call reader with the current state without copying it. Folds wait until reader returns.
+    template <typename Reader>
+    decltype(auto) read(Reader&& reader) const
     {
-        //return false: this enum tag is already associated with a subscription.
-        if(mSubscriptions.contains(subscriptionTag))
-            return false;
+        std::shared_lock lock {mMutex};
+        return std::forward<Reader>(reader)(std::as_const(mState));
+    }
+
+    template <typename Fold, typename EventType>
+    void apply(Fold& fold, EventType const& e)
+    {
+        std::unique_lock lock {mMutex};
+        fold(mState, e);
+    }
 
-        auto const ID { mSubscriber.sub<EventType>(std::move(callback)) };
-        mSubscriptions.try_emplace(subscriptionTag, typeid(EventType), ID);
+private:
+    mutable std::shared_mutex mMutex;
+    State mState;
+};
 
-        return true;
+//Ready made folds for EventSystem::Subscriber::project.
+
+//State should be std::unordered_map<Key, std::size_t> where Key is what keyFn returns.
+template <typename KeyFn>
+auto countByKey(KeyFn keyFn)
+{
+    return [keyFn = std::move(keyFn)](auto& counts, auto const& e){ ++counts[keyFn(e)]; };
+}
+
+//State should be std::unordered_map<Key, Value> where Key and Value are what keyFn and valueFn return.
+template <typename KeyFn, typename ValueFn>
+auto latestByKey(KeyFn keyFn, ValueFn valueFn)
+{
+    return [keyFn = std::move(keyFn), valueFn = std::move(valueFn)](auto& latest, auto const& e)
+    {
+        latest.insert_or_assign(keyFn(e), valueFn(e));
+    };
+}
+
+//State should be std::vector<Value> where Value is what valueFn returns. 
+//The vector is kept sorted by compare (largest first by default) and at most n long.
+template <typename ValueFn, typename Compare = std::greater<>>
+auto topN(std::size_t n, ValueFn valueFn, Compare compare = {})
+{
+    return [n, valueFn = std::move(valueFn), compare = std::move(compare)](auto& top, auto const& e)
+    {
+        auto value { valueFn(e) };
+        auto const pos { std::upper_bound(top.begin(), top.end(), value, compare) };
+
+        if(static_cast<std::size_t>(pos - top.begin()) < n)
+        {
+            top.insert(pos, std::move(value));
+            if(top.size() > n)
+                top.pop_back();
+        }
+    };
+}
+
+//A set of up to 64 user defined resources, one bit each. See SubscriptionOptions::reads/writes.
+using ResourceSet = std::uint64_t;
+
+//What happens to an event published to a subscription whose mailbox is full. See SubscriptionOptions::mailboxCapacity.
+enum class MailboxOverflowPolicy
+{
+    dropNewest, //the new event is not delivered to it
+    dropOldest, //the event that has been waiting longest makes room for it
+    block       //the publisher waits for room
+};
+
+class ThreadPool;
+
+//Extra settings for EventSystem::Subscriber::sub.
+struct SubscriptionOptions
+{
+    //This subscription is called after these subscriptions to the same event type (physics before audio).
+    //Subscriptions that dont depend on each other can run at the same time with Publisher::pubParallel.
+    std::vector<SubscriptionID> after {};
+
+    //The resources (components, subsystems, ...) that this subscription reads and writes, as bitmasks of
+    //bits that the user assigns to their resources. EventSystem::dispatchQueuedParallel runs subscriptions
+    //at the same time when these dont conflict. A subscription that declares neither is assumed to touch
+    //everything and never runs alongside anything else.
+    ResourceSet reads {0};
+    ResourceSet writes {0};
+
+    //Let EventSystem::enableOffloading move this subscription onto its ThreadPool while calls to it are
+    //expensive. An offloaded callback gets a copy of the event and runs after the publish returns, at the
+    //same time as anything else, so it must be thread safe and must not rely on the order of its calls.
+    bool allowOffload {false};
+
+    //Give this subscription a mailbox of its own that holds up to this many events, instead of calling it on the
+    //publishing thread. Publishing copies the event into the mailbox and moves on, and the mailbox is worked
+    //through one event at a time, in order, on mailboxPool (or on a thread of its own if that is nullptr), 
+    //so a slow subscription only backs up its own mailbox. 0 means no mailbox. 
+    //After unsub, events still in a pool mailbox are delivered, events still in a thread mailbox are not.
+    //The callback must not unsub its own subscription, and with block it must not publish to itself.
+    std::size_t mailboxCapacity {0};
+    MailboxOverflowPolicy mailboxOverflow {MailboxOverflowPolicy::dropNewest};
+    ThreadPool* mailboxPool {nullptr};
+};
+
+//What EventSystem::mailboxMetrics knows about a subscription with a mailbox (SubscriptionOptions::mailboxCapacity).
+struct MailboxMetrics
+{
+    std::size_t depth;    //events waiting in it now
+    std::size_t maxDepth; //the most that have been waiting at once
+    std::uint64_t postedCount;
+    std::uint64_t processedCount;
+    std::uint64_t droppedCount;
+};
+
+//What EventSystem::offloadMetrics knows about a subscription made with SubscriptionOptions::allowOffload.
+struct OffloadMetrics
+{
+    double averageNanoseconds; //moving average of how long its calls take
+    bool isOffloaded;
+    std::uint64_t offloadedCallCount;
+};
+
+//What dispatchQueued does with an event enqueued with a deadline that has already passed when its turn comes.
+enum class DeadlineMissPolicy
+{
+    deliverLate, //publish it anyway, and count it as missed
+    drop         //dont publish it, and count it as dropped
+};
+
+//See EventSystem::deadlineMetrics.
+struct DeadlineMetrics
+{
+    std::uint64_t metCount;     //published and handled before their deadline
+    std::uint64_t missedCount;  //handled after their deadline
+    std::uint64_t droppedCount; //dropped by DeadlineMissPolicy::drop
+    std::uint64_t heldCount;    //held by pause when their turn came, they are published on resume like any other held event
+};
+
+//Extra settings for EventSystem::pause.
+struct PauseOptions
+{
+    //keep only the latest held event of the type instead of all of them
+    bool coalesce {false};
+
+    //make room for this many held events of the type up front, so holding them doesnt allocate
+    std::size_t reserve {0};
+};
+
+//A fixed set of worker threads that run submitted tasks, used by Publisher::pubParallel.
+class ThreadPool
+{
+public:
+    explicit ThreadPool(std::size_t threadCount = std::thread::hardware_concurrency())
+    {
+        for(std::size_t i{0}; i < std::max<std::size_t>(threadCount, 1); ++i)
+            mWorkers.emplace_back([this]{ runWorker(); });
     }
 
-    //Returns true if the unsubscription was successful.
-    bool unsub(Enum subscriptionTag)
+    //Tasks that were already submitted still run before the threads are joined.
+    ~ThreadPool()
     {
-        bool wasCallbackRemoved {false};
+        {
+            std::scoped_lock lock {mMutex};
+            mIsStopping = true;
+        }
 
-        if(auto it{mSubscriptions.find(subscriptionTag)}; it != mSubscriptions.end())
+        mWakeUp.notify_all();
+    }
+
+    ThreadPool(ThreadPool const&)=delete;
+    ThreadPool& operator=(ThreadPool const&)=delete;
+
+    void submit(std::function<void()> task)
+    {
         {
-            auto& [typeIndex, subID] = it->second;
-            wasCallbackRemoved = mSubscriber.unsub(subID, typeIndex);
-            if(wasCallbackRemoved) { mSubscriptions.erase(it); }
+            std::scoped_lock lock {mMutex};
+            mTasks.push_back(std::move(task));
         }
 
-        return wasCallbackRemoved;
+        mWakeUp.notify_one();
     }
 
-    void ubsubFromAll()
+    //Run one queued task on the calling thread. Returns false if there was nothing to run.
+    bool tryRunTask()
     {
-        for(auto const& sub : mSubscriptions | std::views::values)
-            mSubscriber.unsub(sub.second, sub.first);
+        std::unique_lock lock {mMutex};
+        if(mTasks.empty())
+            return false;
 
-        mSubscriptions.clear();
+        auto task { std::move(mTasks.front()) };
+        mTasks.pop_front();
+        lock.unlock();
+
+        task();
+        return true;
     }
 
+    std::size_t threadCount() const {return mWorkers.size();}
+
 private:
-    EventSystemSubscriber& mSubscriber;
+    void runWorker()
+    {
+        std::unique_lock lock {mMutex};
 
-    //The Enum tags differentiate between multiple subscriptions to the same event type
-    std::unordered_map<Enum, std::pair<std::type_index, SubscriptionID> > mSubscriptions;
+        for(;;)
+        {
+            mWakeUp.wait(lock, [this]{ return !mTasks.empty() || mIsStopping; });
+
+            if(mTasks.empty())
+                return;
+
+            auto task { std::move(mTasks.front()) };
+            mTasks.pop_front();
+
+            lock.unlock();
+            task();
+            lock.lock();
+        }
+    }
+
+    std::mutex mMutex;
+    std::condition_variable mWakeUp;
+    std::deque<std::function<void()>> mTasks;
+    bool mIsStopping {false};
+    std::vector<std::jthread> mWorkers; //last so the threads are joined before anything else is destroyed
 };
 
-template <typename... EventTs>
-class EventSystem
+//Limits for AdaptiveBatchSizer.
+struct BatchingOptions
+{
+    std::size_t minBatchSize {1};
+    std::size_t maxBatchSize {4096};
+
+    //The longest an event should wait because of batching: time spent lingering for more events to arrive
+    //plus the time it takes to dispatch the batch it ends up in.
+    std::chrono::microseconds latencyCeiling {1000};
+};
+
+//Picks how many events to dispatch at once from how deep the queue is, how fast events are arriving and
+//how long each one has been taking to dispatch. When events trickle in, every event is dispatched as soon
+//as it is seen. Under a burst, batches grow until dispatching one would take longer than the latency ceiling,
+//and when events arrive fast enough the dispatcher lingers briefly so they are picked up in fewer, larger batches.
+//Only the thread doing the dispatching may use this, apart from metrics() which any thread can call.
+class AdaptiveBatchSizer
 {
 public:
+    struct Linger
+    {
+        std::chrono::nanoseconds duration;
+        std::size_t untilBacklog; //stop lingering early once this many events are waiting
+    };
 
-    auto const& getPublisher() const {return mPublisher;}
-    auto& getSubscriber() {return mSubscriber;}
+    struct Metrics
+    {
+        std::size_t lastBatchSize;
+        double averageBatchSize;   //moving average
+        std::size_t maxBatchSize;  //largest batch chosen so far
+        std::uint64_t batchCount;
+        double nanosecondsPerEvent;
+        double arrivalsPerSecond;
+    };
 
-    static_assert((std::is_base_of_v<Event, EventTs> && ...), 
-        "All event types must inherit from Event");  
+    explicit AdaptiveBatchSizer(BatchingOptions options = {}) 
+        : mOptions{options}, mLastObservedAt{std::chrono::steady_clock::now()}
+    {
+        assert(options.minBatchSize > 0 && options.minBatchSize <= options.maxBatchSize);
+    }
 
-    struct Subscriber
+    //How long to wait for more events before taking a batch when backlog are waiting. Zero when events
+    //are not arriving fast enough for waiting to pay off.
+    Linger lingerFor(std::size_t backlog)
     {
-        template <typename EventType>
-        [[nodiscard]] SubscriptionID sub(OnEventCallback callback)
-        {
-            static_assert
-            (
-                IsTypeInPack<EventType, EventTs...>, 
-                "The template type paramater passed to"
-                " EventSystem::Subscriber::sub was not a valid event type for this EventSystem."
-            );
-            
-            auto& callbackVector { mThisEventSys.mCallbackMap[typeid(EventType)] };
-            auto subID { mNextSubscriptionID++ };
-            callbackVector.emplace_back(std::move(callback), subID);
+        observeArrivals(backlog);
 
-            return subID;
-        }
+        auto const ceilingNanoseconds { static_cast<double>(mOptions.latencyCeiling.count()) * 1000.0 };
+        auto const arrivalsPerNanosecond { mArrivalsPerSecond / 1e9 };
 
-        //Returns true if a subscription callback was successfully removed from the event system otherwise returns false.
-        //Takes subID as a reference because if the unsubscription is successful then it resets the id to INVALID_SUBSCRIPTION_ID
-        template <typename EventType>
-        bool unsub(SubscriptionID& subID)
-        {
-            static_assert
-            (
-                IsTypeInPack<EventType, EventTs...>, 
-                "The template type paramater passed to"
-                " EventSystem::Subscriber::unsub was not a valid event type for this EventSystem."
-            );
+        //aim to gather what arrives in half the ceiling, leaving the other half for dispatching it
+        auto const wanted { std::min(arrivalsPerNanosecond * ceilingNanoseconds / 2.0, static_cast<double>(batchSizeCap()) / 2.0) };
+        if(wanted < 2.0 || static_cast<double>(backlog) >= wanted)
+            return {std::chrono::nanoseconds{0}, backlog};
 
-            if(INVALID_SUBSCRIPTION_ID == subID)
-                return false;
+        auto const duration { std::min((wanted - static_cast<double>(backlog)) / arrivalsPerNanosecond, ceilingNanoseconds / 2.0) };
+        return {std::chrono::nanoseconds{static_cast<std::int64_t>(duration)}, static_cast<std::size_t>(wanted)};
+    }
 
-            bool const wasSuccessful { unsub(subID, typeid(EventType)) };
+    //How many of the backlog waiting events to dispatch now. The caller must dispatch exactly that many.
+    std::size_t take(std::size_t backlog)
+    {
+        observeArrivals(backlog);
 
-            if(wasSuccessful)
-                subID = INVALID_SUBSCRIPTION_ID;
+        if(backlog == 0)
+            return 0;
 
-            return wasSuccessful;
-        }
+        auto const batchSize { std::min(backlog, batchSizeCap()) };
+        mTakenSinceObserved += batchSize;
 
-    private:
+        auto const batchCount { mMetrics.batchCount.load(std::memory_order_relaxed) };
+        auto const average { mMetrics.averageBatchSize.load(std::memory_order_relaxed) };
 
-        template <typename Enum, typename>
-        requires std::is_enum_v<Enum>
-        friend class SubscriptionManager;
+        mMetrics.lastBatchSize.store(batchSize, std::memory_order_relaxed);
+        mMetrics.averageBatchSize.store(batchCount == 0 ? batchSize : average + (batchSize - average) * SMOOTHING, std::memory_order_relaxed);
+        mMetrics.maxBatchSize.store(std::max(mMetrics.maxBatchSize.load(std::memory_order_relaxed), batchSize), std::memory_order_relaxed);
+        mMetrics.batchCount.store(batchCount + 1, std::memory_order_relaxed);
 
-        //Overload to take a type_index instead of being templated on EventType.
-        //This is meant to be called from SubscriptionManager only.
-        bool unsub(SubscriptionID subID, std::type_index eventTypeIdx)
+        return batchSize;
+    }
+
+    //Report how long the last batch took to dispatch.
+    void recordDispatchTime(std::size_t eventCount, std::chrono::nanoseconds elapsed)
+    {
+        if(eventCount == 0)
+            return;
+
+        auto const sample { static_cast<double>(elapsed.count()) / static_cast<double>(eventCount) };
+        mNanosecondsPerEvent = mNanosecondsPerEvent == 0.0 ? sample : mNanosecondsPerEvent + (sample - mNanosecondsPerEvent) * SMOOTHING;
+        mMetrics.nanosecondsPerEvent.store(mNanosecondsPerEvent, std::memory_order_relaxed);
+    }
+
+    Metrics metrics() const
+    {
+        return
         {
-            auto it { mThisEventSys.mCallbackMap.find(eventTypeIdx) };
-            if(it != mThisEventSys.mCallbackMap.end())
-            {
-                auto& callbackVector { it->second };
-                
-                //remove the callback associated with this subID.
-                bool wasCallbackErased = std::erase_if(callbackVector, [subID](auto const& callbackIDPair){
-                    return callbackIDPair.second == subID;
-                });
+            mMetrics.lastBatchSize.load(std::memory_order_relaxed),
+            mMetrics.averageBatchSize.load(std::memory_order_relaxed),
+            mMetrics.maxBatchSize.load(std::memory_order_relaxed),
+            mMetrics.batchCount.load(std::memory_order_relaxed),
+            mMetrics.nanosecondsPerEvent.load(std::memory_order_relaxed),
+            mMetrics.arrivalsPerSecond.load(std::memory_order_relaxed)
+        };
+    }
 
-                //if that was the last subscription callback in this vector then remove it from the map
-                if(callbackVector.empty())
-                    mThisEventSys.mCallbackMap.erase(it);
+    BatchingOptions const& options() const {return mOptions;}
 
-                return wasCallbackErased;
-            }
+private:
+    static constexpr double SMOOTHING {0.2};
 
-            return false;
-        }
+    //observations closer together than this are merged so the arrival rate isnt made of noise
+    static constexpr std::chrono::microseconds MIN_OBSERVATION_INTERVAL {50};
 
-        friend class EventSystem<EventTs...>;
-        Subscriber(EventSystem<EventTs...>& thisEventSys) : mThisEventSys{thisEventSys} {}
+    //the largest batch that can be dispatched within the latency ceiling at the current cost per event
+    std::size_t batchSizeCap() const
+    {
+        if(mNanosecondsPerEvent == 0.0)
+            return mOptions.maxBatchSize;
 
-        EventSystem<EventTs...>& mThisEventSys;
+        auto const ceilingNanoseconds { static_cast<double>(mOptions.latencyCeiling.count()) * 1000.0 };
+        auto const fitsInCeiling { ceilingNanoseconds / mNanosecondsPerEvent };
 
-        //start at 1 because INVALID_SUBSCRIPTION_ID is 0
-        SubscriptionID mNextSubscriptionID {1};
-    };
+        if(fitsInCeiling >= static_cast<double>(mOptions.maxBatchSize))
+            return mOptions.maxBatchSize;
 
-    struct Publisher
+        return std::max(mOptions.minBatchSize, static_cast<std::size_t>(fitsInCeiling));
+    }
+
+    //whatever the backlog grew by, counting what was taken out of it, has arrived since the last observation
+    void observeArrivals(std::size_t backlog)
     {
-        template <typename EventType>
-        void pub(EventType& e) const
+        auto const now { std::chrono::steady_clock::now() };
+        auto const elapsed { now - mLastObservedAt };
+
+        if(elapsed < MIN_OBSERVATION_INTERVAL)
+            return;
+
+        auto const arrivals { backlog + mTakenSinceObserved - std::min(mLastBacklog, backlog + mTakenSinceObserved) };
+        auto const sample { static_cast<double>(arrivals) / std::chrono::duration<double>(elapsed).count() };
+
+        mArrivalsPerSecond += (sample - mArrivalsPerSecond) * SMOOTHING;
+        mMetrics.arrivalsPerSecond.store(mArrivalsPerSecond, std::memory_order_relaxed);
+
+        mLastBacklog = backlog;
+        mTakenSinceObserved = 0;
+        mLastObservedAt = now;
+    }
+
+    BatchingOptions mOptions;
+
+    std::size_t mLastBacklog {0};
+    std::size_t mTakenSinceObserved {0};
+    std::chrono::steady_clock::time_point mLastObservedAt;
+    double mArrivalsPerSecond {0.0};
+    double mNanosecondsPerEvent {0.0};
+
+    struct
+    {
+        std::atomic<std::size_t> lastBatchSize {0};
+        std::atomic<double> averageBatchSize {0.0};
+        std::atomic<std::size_t> maxBatchSize {0};
+        std::atomic<std::uint64_t> batchCount {0};
+        std::atomic<double> nanosecondsPerEvent {0.0};
+        std::atomic<double> arrivalsPerSecond {0.0};
+    } mMetrics;
+};
+
+//Remembers the keys seen in the last window of time in a fixed number of slots, for EventSystem::dedup.
+//Open addressing with a short linear probe: a key is looked for in all MAX_PROBES slots from where it hashes to
+//(an expired slot in front of it doesnt mean it isnt further along), and a new key takes the first empty or 
+//expired slot among them, or evicts the one that expires soonest. 
+//So a check is O(1) and the memory never grows, at the cost of forgetting keys early when more than 
+//about capacity different keys are live at once (those events are then let through, never wrongly dropped).
+class DedupTable
+{
+public:
+    explicit DedupTable(std::chrono::steady_clock::duration window, std::size_t capacity = 1024)
+        : mWindow{window}, mSlots(std::bit_ceil(std::max<std::size_t>(capacity, MAX_PROBES)))
+    {
+    }
+
+    //True if key was let through less than window ago. Otherwise remembers key as let through now.
+    bool isDuplicate(std::uint64_t key, std::chrono::steady_clock::time_point now)
+    {
+        key = key == EMPTY ? 1 : key;
+
+        std::scoped_lock lock {mMutex};
+
+        auto const mask { mSlots.size() - 1 };
+        auto const home { static_cast<std::size_t>(mix(key)) & mask };
+        Slot* victim { nullptr };
+        Slot* soonest { &mSlots[home] };
+
+        for(std::size_t probe{0}; probe < MAX_PROBES; ++probe)
         {
-            static_assert
-            (
-                IsTypeInPack<EventType, EventTs...>,
-                "The template type paramater passed to"
-                " EventSystem::pub was not a valid event type for this EventSystem."
-            );
-        
-            //find the list of callbacks associated with this event type (if any)
-            auto const it { mThisEventSys.mCallbackMap.find(typeid(e)) };
-            
-            if(it != mThisEventSys.mCallbackMap.end())
+            auto& slot { mSlots[(home + probe) & mask] };
+
+            if(slot.key == key)
             {
-                for(auto const& callbackAndIDPair : it->second)
-                    callbackAndIDPair.first(e);
+                if(now < slot.expiry)
+                {
+                    ++mDroppedCount;
+                    return true;
+                }
+
+                victim = &slot;
+                break;
             }
+
+            if(victim == nullptr && (slot.key == EMPTY || slot.expiry <= now))
+                victim = &slot;
+
+            if(slot.expiry < soonest->expiry)
+                soonest = &slot;
         }
 
-    private:
+        *(victim ? victim : soonest) = {key, now + mWindow};
+        return false;
+    }
 
-        friend class EventSystem<EventTs...>;
-        Publisher(EventSystem<EventTs...> const& thisEventSys) : mThisEventSys{thisEventSys} {}
+    std::uint64_t droppedCount() const 
+    {
+        std::scoped_lock lock {mMutex};
+        return mDroppedCount;
+    }
+
+private:
+    static constexpr std::uint64_t EMPTY {0};
+    static constexpr std::size_t MAX_PROBES {8};
 
-        EventSystem<EventTs...> const& mThisEventSys;
+    struct Slot
+    {
+        std::uint64_t key {EMPTY};
+        std::chrono::steady_clock::time_point expiry {};
     };
 
-    friend struct Subscriber;
-    friend struct Publisher;
+    //user keys are often small sequential numbers, spread them over the table
+    static std::uint64_t mix(std::uint64_t key)
+    {
+        key ^= key >> 33;
+        key *= 0xff51afd7ed558ccdull;
+        key ^= key >> 33;
+        return key;
+    }
 
-private:
-    //A map from event types -> a list of subscription callbacks.
-    std::unordered_map<std::type_index, 
-        std::vector<std::pair<OnEventCallback, SubscriptionID>>> mCallbackMap;
+    std::chrono::steady_clock::duration mWindow;
+    std::vector<Slot> mSlots;
+    std::uint64_t mDroppedCount {0};
+    mutable std::mutex mMutex;
+};
 
-    //use getSubscriber()/getPublisher() to get access to these, allowing the 
-    //user of this event system to sub/unsub or publish events respectively.
-    Subscriber mSubscriber {*this};
-    Publisher  mPublisher  {*this};
+//Identifies one entity (game object, connection, account, ...) for Subscriber::subTo and Publisher::pubTo.
+using EntityID = std::uint32_t;
+
+//The subscriptions of one event type that are addressed to single entities (Subscriber::subTo).
+//This is a sparse set: the paged sparse array maps an EntityID to the first of its subscriptions in 
+//the dense arrays, and the subscriptions of one entity are linked together by dense index, with the 
+//prev of the first one pointing at the last one. Delivering to an entity, adding and removing are all 
+//O(1) no matter how many entities there are. Removing swaps the last dense element into the hole, 
+//so the dense arrays never have gaps.
+class EntitySubscriberTable
+{
+public:
+    void add(EntityID entity, OnEventCallback callback, SubscriptionID subID)
+    {
+        //Appending to mCallbacks under a dispatch loop could move the callback that is running, it is added once the loop is done.
+        if(mDispatchDepth > 0)
+        {
+            mPendingAdds.emplace_back(entity, std::move(callback), subID);
+            return;
+        }
+
+        link(entity, std::move(callback), subID);
+    }
+
+    //Returns false if entity has no subscription with subID.
+    bool remove(EntityID entity, SubscriptionID subID)
+    {
+        auto const denseIndex { find(entity, subID) };
+        if(denseIndex == NONE)
+        {
+            auto const pendingIt { std::ranges::find_if(mPendingAdds, [&](auto const& pending){ return pending.entity == entity && pending.ID == subID; }) };
+            if(pendingIt == mPendingAdds.end())
+                return false;
+
+            mPendingAdds.erase(pendingIt);
+            return true;
+        }
+
+        //Dont move anything around under a dispatch loop, it is removed once the loop is done.
+        if(mDispatchDepth > 0)
+        {
+            mLinks[denseIndex].ID = INVALID_SUBSCRIPTION_ID;
+            mPendingRemovals.push_back(denseIndex);
+            return true;
+        }
+
+        erase(denseIndex);
+        return true;
+    }
+
+    //Call every subscription of entity with e.
+    void dispatch(EntityID entity, Event const& e)
+    {
+        auto const head { sparseIndex(entity) };
+        if(head == NONE)
+            return;
+
+        ++mDispatchDepth;
+
+        //Stop at the subscription that was last when dispatch started, so ones added during it are not called.
+        auto const last { mLinks[head].prev };
+        for(auto i{head};; i = mLinks[i].next)
+        {
+            if(mLinks[i].ID != INVALID_SUBSCRIPTION_ID)
+                mCallbacks[i](e);
+
+            if(i == last)
+                break;
+        }
+
+        if(--mDispatchDepth == 0)
+        {
+            //erase the highest indices first since erasing moves the last element into the hole
+            std::ranges::sort(mPendingRemovals, std::greater<>{});
+            for(auto denseIndex : mPendingRemovals)
+                erase(denseIndex);
+
+            mPendingRemovals.clear();
+
+            for(auto& pending : mPendingAdds)
+                link(pending.entity, std::move(pending.callback), pending.ID);
+
+            mPendingAdds.clear();
+        }
+    }
+
+    void reserve(std::size_t subscriptionCount)
+    {
+        mLinks.reserve(subscriptionCount);
+        mCallbacks.reserve(subscriptionCount);
+    }
+
+private:
+    static constexpr std::uint32_t NONE { UINT32_MAX };
+    static constexpr std::uint32_t PAGE_SIZE { 4096 };
+
+    struct Link
+    {
+        SubscriptionID ID;
+        EntityID entity;
+        std::uint32_t prev;
+        std::uint32_t next;
+    };
+
+    //an add made during dispatch
+    struct PendingAdd
+    {
+        EntityID entity;
+        OnEventCallback callback;
+        SubscriptionID ID;
+    };
+
+    void link(EntityID entity, OnEventCallback callback, SubscriptionID subID)
+    {
+        auto const newIndex { static_cast<std::uint32_t>(mLinks.size()) };
+        auto& head { sparseSlot(entity) };
+
+        if(head == NONE)
+        {
+            mLinks.emplace_back(subID, entity, newIndex, NONE);
+            head = newIndex;
+        }
+        else
+        {
+            //append after the last subscription of this entity so they are called in the order they were added
+            auto const tail { mLinks[head].prev };
+            mLinks.emplace_back(subID, entity, tail, NONE);
+            mLinks[tail].next = newIndex;
+            mLinks[head].prev = newIndex;
+        }
+
+        mCallbacks.push_back(std::move(callback));
+    }
+
+    std::uint32_t sparseIndex(EntityID entity) const
+    {
+        auto const page { entity / PAGE_SIZE };
+        if(page >= mSparsePages.size() || !mSparsePages[page])
+            return NONE;
+
+        return mSparsePages[page][entity % PAGE_SIZE];
+    }
+
+    std::uint32_t& sparseSlot(EntityID entity)
+    {
+        auto const page { entity / PAGE_SIZE };
+        if(page >= mSparsePages.size())
+            mSparsePages.resize(page + 1);
+
+        if(!mSparsePages[page])
+        {
+            mSparsePages[page] = std::make_unique<std::uint32_t[]>(PAGE_SIZE);
+            std::fill_n(mSparsePages[page].get(), PAGE_SIZE, NONE);
+        }
+
+        return mSparsePages[page][entity % PAGE_SIZE];
+    }
+
+    std::uint32_t find(EntityID entity, SubscriptionID subID) const
+    {
+        for(auto i { sparseIndex(entity) }; i != NONE; i = mLinks[i].next)
+        {
+            if(mLinks[i].ID == subID)
+                return i;
+        }
+
+        return NONE;
+    }
+
+    void erase(std::uint32_t denseIndex)
+    {
+        unlink(denseIndex);
+
+        auto const lastIndex { static_cast<std::uint32_t>(mLinks.size() - 1) };
+        if(denseIndex != lastIndex)
+        {
+            mLinks[denseIndex] = mLinks[lastIndex];
+            mCallbacks[denseIndex] = std::move(mCallbacks[lastIndex]);
+
+            //point everything that referred to the moved element at its new index
+            auto const& moved { mLinks[denseIndex] };
+            auto& head { sparseSlot(moved.entity) };
+
+            if(head == lastIndex)
+                head = denseIndex;
+            else
+                mLinks[moved.prev].next = denseIndex;
+
+            if(moved.next != NONE)
+                mLinks[moved.next].prev = denseIndex;
+            else
+                mLinks[head].prev = denseIndex;
+        }
+
+        mLinks.pop_back();
+        mCallbacks.pop_back();
+    }
+
+    void unlink(std::uint32_t denseIndex)
+    {
+        auto const link { mLinks[denseIndex] };
+        auto& head { sparseSlot(link.entity) };
+
+        if(head == denseIndex)
+        {
+            if(link.next != NONE)
+                mLinks[link.next].prev = link.prev;
+
+            head = link.next;
+        }
+        else
+        {
+            mLinks[link.prev].next = link.next;
+
+            if(link.next != NONE)
+                mLinks[link.next].prev = link.prev;
+            else
+                mLinks[head].prev = link.prev;
+        }
+    }
+
+    std::vector<std::unique_ptr<std::uint32_t[]>> mSparsePages;
+
+    //dense, one element per subscription. The callbacks are kept apart from the links so walking the links stays compact.
+    std::vector<Link> mLinks;
+    std::vector<OnEventCallback> mCallbacks;
+
+    std::vector<std::uint32_t> mPendingRemovals;
+    std::vector<PendingAdd> mPendingAdds;
+    std::uint32_t mDispatchDepth {0};
+};
+
+//Using this SubscriptionManager is optional, you can use the EventSystem without it.
+//Enum should be an enum type that you associate with a particular subscription.
+//You can subscribe to the same type multiple times as long as the enum value differs for each one.
+//EventSystemSubscriber should be EventSystem::Subscriber.
+template <typename Enum, typename EventSystemSubscriber>
+requires std::is_enum_v<Enum>
+class SubscriptionManager
+{
+public:
+    SubscriptionManager(EventSystemSubscriber& subscriber) : mSubscriber{subscriber} {};
+
+    ~SubscriptionManager()
+    {
+        ubsubFromAll();
+    }
+
+    //Returns false if subscriptionTag is already associated with a subscription.
+    //This could be the case if you accidentally call this function twice with the same enum or
+    //if you accidentally map two different enums to the same integer value... dont do this.
+    template <typename EventType>
+    bool sub(Enum subscriptionTag, OnEventCallback callback)
+    {
+        //return false: this enum tag is already associated with a subscription.
+        if(mSubscriptions.contains(subscriptionTag))
+            return false;
+
+        auto const ID { mSubscriber.template sub<EventType>(std::move(callback)) };
+
+        //compiled out event types never produce a real subscription so there is nothing to track.
+        if(ID != INVALID_SUBSCRIPTION_ID)
+            mSubscriptions.try_emplace(subscriptionTag, typeid(EventType), ID);
+
+        return true;
+    }
+
+    //Returns true if the unsubscription was successful.
+    bool unsub(Enum subscriptionTag)
+    {
+        bool wasCallbackRemoved {false};
+
+        if(auto it{mSubscriptions.find(subscriptionTag)}; it != mSubscriptions.end())
+        {
+            auto& [typeIndex, subID] = it->second;
+            wasCallbackRemoved = mSubscriber.unsub(subID, typeIndex);
+            if(wasCallbackRemoved) { mSubscriptions.erase(it); }
+        }
+
+        return wasCallbackRemoved;
+    }
+
+    void ubsubFromAll()
+    {
+        for(auto const& sub : mSubscriptions | std::views::values)
+            mSubscriber.unsub(sub.second, sub.first);
+
+        mSubscriptions.clear();
+    }
+
+private:
+    EventSystemSubscriber& mSubscriber;
+
+    //The Enum tags differentiate between multiple subscriptions to the same event type
+    std::unordered_map<Enum, std::pair<std::type_index, SubscriptionID> > mSubscriptions;
+};
+
+//A handler wired up at compile time for a StaticEventSystem. Handler is a function pointer,
+//or an object of a stateless type with a const operator(), that takes an EventType const&.
+template <typename HandledEventType, auto Handler>
+struct StaticHandler
+{
+    using EventType = HandledEventType;
+
+    static void call(EventType const& e) { std::invoke(Handler, e); }
+};
+
+//The compile time handler list of a StaticEventSystem.
+template <typename... Handlers>
+struct StaticHandlers
+{
+    template <typename EventType>
+    static constexpr bool handles { (std::is_same_v<typename Handlers::EventType, EventType> || ...) };
+
+    //Expands into a direct call to each handler of EventType in the order they are listed.
+    template <typename EventType>
+    static void dispatch(EventType const& e)
+    {
+        ([&e]
+        {
+            if constexpr(std::is_same_v<typename Handlers::EventType, EventType>)
+                Handlers::call(e);
+        }(), ...);
+    }
+};
+
+//Use the EventSystem or StaticEventSystem aliases below rather than naming this directly.
+template <typename StaticHandlerList, typename... EventTs>
+class BasicEventSystem
+{
+public:
+
+    auto const& getPublisher() const {return mPublisher;}
+    auto& getSubscriber() {return mSubscriber;}
+
+    //Publish everything enqueued with Publisher::enqueue/reply or committed with a Batch (from any thread) since the last call,
+    //in the order it was enqueued, on the calling thread. Replies are handed to the onReply callback of
+    //their request instead of being broadcast, and requests that have timed out are expired.
+    //Events enqueued by callbacks during this call are dispatched on the next call.
+    //If maxEvents is given, at most that many are dispatched (more only to finish a Batch) and the rest wait for the next call.
+    //Returns the number of queued events that were dispatched.
+    std::size_t dispatchQueued(std::size_t maxEvents = SIZE_MAX)
+    {
+        static constexpr std::array dispatchers { &BasicEventSystem::dispatchQueuedEvent<EventTs>... };
+
+        mSubscriber.applyMutations();
+
+        std::size_t dispatchedCount {0};
+        bool hasTakenQueuedEvents {false};
+        bool isInsideBatch {false};
+        auto const deadlineSequenceEnd { nextDeadlineSequence() };
+
+        //never stop in the middle of a Batch, its events are seen all at once or not at all
+        while(dispatchedCount < maxEvents || isInsideBatch)
+        {
+            //events with deadlines go first, but not into the middle of a Batch
+            if(!isInsideBatch)
+            {
+                if(auto const result { dispatchNextDeadlineEvent(deadlineSequenceEnd) }; result != DeadlineDispatch::none)
+                {
+                    dispatchedCount += result == DeadlineDispatch::dispatched;
+                    continue;
+                }
+            }
+
+            //finish what an earlier call with a maxEvents left over before taking anything new
+            if(mDispatchCursor == mDispatchingEvents.order.size())
+            {
+                finishDispatchingQueued();
+
+                if(hasTakenQueuedEvents || !takeQueuedEvents())
+                    break;
+
+                hasTakenQueuedEvents = true;
+            }
+
+            auto const& entry { mDispatchingEvents.order[mDispatchCursor++] };
+            isInsideBatch = entry.continuesBatch;
+            (this->*dispatchers[entry.typeIndex])(entry);
+            ++dispatchedCount;
+        }
+
+        if(mDispatchCursor == mDispatchingEvents.order.size())
+            finishDispatchingQueued();
+
+        expireRequests(std::chrono::steady_clock::now());
+
+        return dispatchedCount;
+    }
+
+    //Does the same as dispatchQueued, with batches sized by sizer to keep up with the queue within
+    //its latency ceiling. Call it in a loop on the dispatching thread; it never blocks.
+    std::size_t dispatchQueued(AdaptiveBatchSizer& sizer)
+    {
+        auto const batchSize { sizer.take(queuedCount()) };
+
+        auto const startTime { std::chrono::steady_clock::now() };
+        auto const dispatchedCount { dispatchQueued(batchSize) };
+        sizer.recordDispatchTime(dispatchedCount, std::chrono::steady_clock::now() - startTime);
+
+        return dispatchedCount;
+    }
+
+#ifndef _WIN32
+    //Set up Publisher::pubFromSignal. Call this on the thread that owns this EventSystem before installing
+    //any signal handler that uses it. Returns a file descriptor that becomes readable whenever events have been
+    //published from a signal handler: add it to the owner's poll/epoll loop and call dispatchSignalEvents when it is.
+    int enableSignalPublishing()
+    {
+        if(!mSignalQueue)
+            mSignalQueue = std::make_unique<SignalQueue>();
+
+        return mSignalQueue->readFd;
+    }
+
+    //Publish, on the calling thread, everything that Publisher::pubFromSignal queued. Returns how many there were.
+    std::size_t dispatchSignalEvents()
+    {
+        if(!mSignalQueue)
+            return 0;
+
+        mSignalQueue->clearWakeUp();
+
+        std::size_t dispatchedCount {0};
+        while(mSignalQueue->popAndPublish(*this))
+            ++dispatchedCount;
+
+        return dispatchedCount;
+    }
+
+    //Events that pubFromSignal dropped because the queue was full.
+    std::uint64_t droppedSignalEventCount() const
+    {
+        return mSignalQueue ? mSignalQueue->droppedCount.load(std::memory_order_relaxed) : 0;
+    }
+#endif
+
+    //Drop events of EventType that are published less than window after an identical one that was let through,
+    //before anything (static handlers, subscriptions, the publish hook) sees them. Identical means the same keyOf.
+    //There is no default key: event types derive from the polymorphic Event so their bytes (vptr, padding) 
+    //never say whether two events are the same. Applies to pub, pubParallel, pubTo, channels, enqueue (checked 
+    //when enqueued) and pubFromSignal. Up to about capacity different keys are remembered at once. 
+    //Pass a zero window to turn it off, keyOf can be empty then. Set this while nothing is being published.
+    template <typename EventType>
+    void dedup(std::chrono::steady_clock::duration window, 
+        std::function<std::uint64_t(EventType const&)> keyOf, std::size_t capacity = 1024)
+    {
+        static_assert
+        (
+            IsTypeInPack<EventType, EventTs...>,
+            "The template type paramater passed to"
+            " EventSystem::dedup was not a valid event type for this EventSystem."
+        );
+
+        if constexpr(!IsCompiledOutEvent<EventType>)
+        {
+            auto& dedup { mDedups[StorageIndexOf<EventType>] };
+
+            if(window <= std::chrono::steady_clock::duration::zero())
+            {
+                dedup.reset();
+                return;
+            }
+
+            assert(keyOf && "dedup needs a key function to tell events apart");
+
+            dedup = std::make_unique<Dedup>(window, capacity, [keyOf = std::move(keyOf)](Event const& e)
+            {
+                return keyOf(e.template unpack<EventType>());
+            });
+        }
+    }
+
+    //How many events of EventType dedup has dropped.
+    template <typename EventType>
+    std::uint64_t droppedDuplicateCount() const
+    {
+        if constexpr(IsCompiledOutEvent<EventType>)
+        {
+            return 0;
+        }
+        else
+        {
+            auto const& dedup { mDedups[StorageIndexOf<EventType>] };
+            return dedup ? dedup->table.droppedCount() : 0;
+        }
+    }
+
+    //Hold the events of EventType published from now on (by pub, pubParallel, channels and the queued dispatches,
+    //but not pubTo or replies) instead of dispatching them, until resume. Nothing sees a held event until then,
+    //not even the publish hook. With options.coalesce only the latest held event is kept, in the place of the first.
+    //The held events are kept by value in storage that is reused from one pause to the next.
+    //Call pause and resume from the thread that publishes.
+    template <typename EventType>
+    void pause(PauseOptions const& options = {})
+    {
+        static_assert
+        (
+            IsTypeInPack<EventType, EventTs...>,
+            "The template type paramater passed to"
+            " EventSystem::pause was not a valid event type for this EventSystem."
+        );
+
+        if constexpr(!IsCompiledOutEvent<EventType>)
+        {
+            static_assert(std::is_copy_constructible_v<EventType> && std::is_copy_assignable_v<EventType>, 
+                "Only copyable event types can be paused.");
+
+            constexpr auto typeIndex { IndexInPack<EventType, EventTs...> };
+            auto& pauseState { mPauseStates[StorageIndexOf<EventType>] };
+
+            if(!pauseState.isPaused)
+                ++mPausedTypeCount;
+
+            pauseState.isPaused = true;
+            subscribersOf<EventType>().specialCases |= SubscriberList::IS_PAUSED;
+            pauseState.coalesce = options.coalesce;
+
+            std::get<typeIndex>(mPausedEvents.events).reserve(options.reserve);
+            mPausedEvents.order.reserve(mPausedEvents.order.size() + options.reserve);
+        }
+    }
+
+    //pause every event type that can be paused.
+    void pauseAll(PauseOptions const& options = {})
+    {
+        ([&]
+        {
+            if constexpr(std::is_copy_constructible_v<EventTs> && std::is_copy_assignable_v<EventTs>)
+                pause<EventTs>(options);
+        }(), ...);
+    }
+
+    //Stop holding events of EventType and publish the ones that were held, oldest first.
+    //Events of other types that are still paused stay held.
+    template <typename EventType>
+    void resume()
+    {
+        static_assert
+        (
+            IsTypeInPack<EventType, EventTs...>,
+            "The template type paramater passed to"
+            " EventSystem::resume was not a valid event type for this EventSystem."
+        );
+
+        if constexpr(!IsCompiledOutEvent<EventType>)
+        {
+            constexpr auto typeIndex { IndexInPack<EventType, EventTs...> };
+            auto& pauseState { mPauseStates[StorageIndexOf<EventType>] };
+
+            if(!pauseState.isPaused)
+                return;
+
+            pauseState = {};
+            --mPausedTypeCount;
+            subscribersOf<EventType>().specialCases &= ~SubscriberList::IS_PAUSED;
+
+            //take them out first, a subscription might pause this type again while they are published
+            auto& heldEvents { std::get<typeIndex>(mPausedEvents.events) };
+            auto events { std::move(heldEvents) };
+            heldEvents.clear();
+
+            std::erase_if(mPausedEvents.order, [](auto const& entry){ return entry.typeIndex == typeIndex; });
+
+            for(auto& e : events)
+                publish(e, subscribersOf<EventType>());
+
+            //hand the storage back for the next pause
+            if(heldEvents.empty())
+            {
+                events.clear();
+                heldEvents = std::move(events);
+            }
+        }
+    }
+
+    //Stop holding events of every type and publish all of the held events in the order they were published in.
+    void resumeAll()
+    {
+        if(mPausedTypeCount == 0)
+            return;
+
+        mPauseStates = {};
+        mPausedTypeCount = 0;
+
+        for(auto& subscriberList : mSubscriberLists)
+            subscriberList.specialCases &= ~SubscriberList::IS_PAUSED;
+
+        EventQueue events;
+        std::swap(events, mPausedEvents);
+
+        static constexpr std::array publishers { &BasicEventSystem::publishHeldEvent<EventTs>... };
+
+        for(auto const& entry : events.order)
+            (this->*publishers[entry.typeIndex])(events, entry);
+
+        if(mPausedEvents.order.empty())
+        {
+            events.clear();
+            std::swap(events, mPausedEvents);
+        }
+    }
+
+    //How many events are being held by pause.
+    std::size_t pausedEventCount() const
+    {
+        return mPausedEvents.order.size();
+    }
+
+    //How the events of EventType enqueued with a deadline have fared so far.
+    template <typename EventType>
+    DeadlineMetrics deadlineMetrics() const
+    {
+        if constexpr(IsCompiledOutEvent<EventType>)
+        {
+            return {};
+        }
+        else
+        {
+            auto const& counters { mDeadlineCounters[StorageIndexOf<EventType>] };
+            return
+            {
+                counters.metCount.load(std::memory_order_relaxed),
+                counters.missedCount.load(std::memory_order_relaxed),
+                counters.droppedCount.load(std::memory_order_relaxed),
+                counters.heldCount.load(std::memory_order_relaxed)
+            };
+        }
+    }
+
+    //Time the calls to subscriptions made with SubscriptionOptions::allowOffload, and call the ones that have been
+    //taking longer than threshold on average on pool instead of inline, so they stop holding up the publisher. 
+    //One goes back to being called inline once its average drops below half the threshold.
+    //Subscriptions that dont allow offloading are never timed or moved. Set this while nothing is being published.
+    //pool must stay alive while offloading is enabled.
+    void enableOffloading(ThreadPool& pool, std::chrono::nanoseconds threshold)
+    {
+        mOffloading = {&pool, threshold};
+    }
+
+    void disableOffloading()
+    {
+        mOffloading = {};
+    }
+
+    template <typename EventType>
+    OffloadMetrics offloadMetrics(SubscriptionID subID)
+    {
+        static_assert
+        (
+            IsTypeInPack<EventType, EventTs...>, 
+            "The template type paramater passed to"
+            " EventSystem::offloadMetrics was not a valid event type for this EventSystem."
+        );
+
+        if constexpr(IsCompiledOutEvent<EventType>)
+        {
+            return {0.0, false, 0};
+        }
+        else
+        {
+            auto& subscriberList { subscribersOf<EventType>() };
+            auto const it { subscriberList.find(subID) };
+
+            if(it == subscriberList.subscriptions.end() || !it->offload)
+                return {0.0, false, 0};
+
+            auto const& state { *it->offload };
+            return
+            {
+                state.averageNanoseconds.load(std::memory_order_relaxed), 
+                state.isOffloaded.load(std::memory_order_relaxed), 
+                state.offloadedCallCount.load(std::memory_order_relaxed)
+            };
+        }
+    }
+
+    template <typename EventType>
+    MailboxMetrics mailboxMetrics(SubscriptionID subID)
+    {
+        static_assert
+        (
+            IsTypeInPack<EventType, EventTs...>, 
+            "The template type paramater passed to"
+            " EventSystem::mailboxMetrics was not a valid event type for this EventSystem."
+        );
+
+        if constexpr(IsCompiledOutEvent<EventType>)
+        {
+            return {0, 0, 0, 0, 0};
+        }
+        else
+        {
+            auto& subscriberList { subscribersOf<EventType>() };
+            auto const it { subscriberList.find(subID) };
+
+            if(it == subscriberList.subscriptions.end() || !it->mailbox)
+                return {0, 0, 0, 0, 0};
+
+            return it->mailbox->metrics();
+        }
+    }
+
+    //Apply every Subscriber::subConcurrent/unsubConcurrent made so far, for a thread that publishes with pub 
+    //and never calls dispatchQueued. Call it from the thread that publishes, outside of any callback.
+    void applyConcurrentSubscriptions()
+    {
+        mSubscriber.applyMutations();
+    }
+
+    //Call hook with context for every event published from now on, on the publishing thread, before any handler
+    //sees it. This covers pub, pubParallel, pubTo, channels and the queued dispatches, but not replies.
+    //Pass nullptr to remove it. Set it while nothing is being published.
+    void setPublishHook(PublishHook hook, void* context)
+    {
+        mPublishHook = hook;
+        mPublishHookContext = context;
+    }
+
+    //How many events are waiting for dispatchQueued. Only call this from the thread that calls dispatchQueued.
+    std::size_t queuedCount()
+    {
+        std::scoped_lock lock {mQueueMutex};
+        return mQueuedEvents.order.size() + (mDispatchingEvents.order.size() - mDispatchCursor) + mDeadlineEvents.heap.size();
+    }
+
+    //notify is called (on the enqueueing thread) after every enqueue/reply, so something that drains this 
+    //EventSystem's queue from another thread can sleep until there is work. Pass an empty function to remove it.
+    //Can be called while other threads enqueue, once it returns the old notify is not running and wont be called again.
+    void setQueueNotifier(std::function<void()> notify)
+    {
+        std::scoped_lock lock {mQueueNotifierMutex};
+        mHasQueueNotifier.store(static_cast<bool>(notify), std::memory_order_release);
+        mQueueNotifier = std::move(notify);
+    }
+
+    //Does the same as dispatchQueued, with the same results, but the subscriptions for the whole batch of
+    //queued events run on pool at the same time wherever their SubscriptionOptions::reads/writes dont conflict.
+    //Subscriptions that conflict, and calls of the same subscription, keep the order dispatchQueued would use.
+    //Static handlers and replies to requests have no declared resources so they run on their own.
+    //Callbacks can unsub during this but must not sub or replace.
+    std::size_t dispatchQueuedParallel(ThreadPool& pool)
+    {
+        mSubscriber.applyMutations();
+
+        //events with deadlines go first, one at a time
+        std::size_t deadlineDispatchedCount {0};
+
+        for(auto const deadlineSequenceEnd { nextDeadlineSequence() };;)
+        {
+            auto const result { dispatchNextDeadlineEvent(deadlineSequenceEnd) };
+            if(result == DeadlineDispatch::none)
+                break;
+
+            deadlineDispatchedCount += result == DeadlineDispatch::dispatched;
+        }
+
+        if(mDispatchCursor == mDispatchingEvents.order.size())
+        {
+            finishDispatchingQueued();
+            takeQueuedEvents();
+        }
+
+        if(mPausedTypeCount != 0)
+            holdPausedQueuedEvents();
+
+        auto const dispatchedCount { mDispatchingEvents.order.size() - mDispatchCursor };
+
+        if(mPublishHook != nullptr)
+        {
+            static constexpr std::array hookCallers { &BasicEventSystem::callPublishHookForQueued<EventTs>... };
+
+            for(auto i { mDispatchCursor }; i < mDispatchingEvents.order.size(); ++i)
+                (this->*hookCallers[mDispatchingEvents.order[i].typeIndex])(mDispatchingEvents.order[i]);
+        }
+
+        for(auto& subscriberList : mSubscriberLists)
+            ++subscriberList.dispatchDepth;
+
+        scheduleBatch();
+
+        static constexpr std::array runners { &BasicEventSystem::runBatchItem<EventTs>... };
+        auto const runItem = [this](BatchItem const& item)
+        {
+            (this->*runners[mDispatchingEvents.order[item.entryIndex].typeIndex])(item);
+        };
+
+        //Run the batch one wave at a time. Nothing within a wave conflicts with anything else in it.
+        for(auto waveBegin { mBatchItems.begin() }; waveBegin != mBatchItems.end();)
+        {
+            auto const waveEnd 
+            {
+                std::find_if(waveBegin, mBatchItems.end(), [wave = waveBegin->wave](auto const& item){ return item.wave != wave; })
+            };
+
+            if(waveEnd - waveBegin == 1)
+            {
+                runItem(*waveBegin);
+            }
+            else
+            {
+                std::atomic<std::ptrdiff_t> itemsLeft { waveEnd - waveBegin };
+
+                for(auto it { waveBegin }; it != waveEnd; ++it)
+                {
+                    pool.submit([&runItem, &itemsLeft, item = *it]
+                    {
+                        runItem(item);
+                        itemsLeft.fetch_sub(1, std::memory_order_release);
+                    });
+                }
+
+                while(itemsLeft.load(std::memory_order_acquire) > 0)
+                {
+                    if(!pool.tryRunTask())
+                        std::this_thread::yield();
+                }
+            }
+
+            waveBegin = waveEnd;
+        }
+
+        for(auto& subscriberList : mSubscriberLists)
+            endDispatch(subscriberList);
+
+        finishDispatchingQueued();
+        expireRequests(std::chrono::steady_clock::now());
+
+        return deadlineDispatchedCount + dispatchedCount;
+    }
+
+    static_assert((std::is_base_of_v<Event, EventTs> && ...), 
+        "All event types must inherit from Event");  
+
+    struct Subscriber
+    {
+        template <typename EventType>
+        [[nodiscard]] SubscriptionID sub(OnEventCallback callback)
+        {
+            return addSubscription<EventType>(std::move(callback), UNLIMITED_CALLS);
+        }
+
+        //Subscribe with extra options, for example to be called after other subscriptions.
+        template <typename EventType>
+        [[nodiscard]] SubscriptionID sub(OnEventCallback callback, SubscriptionOptions const& options)
+        {
+            return addSubscription<EventType>(std::move(callback), UNLIMITED_CALLS, options);
+        }
+
+        //Subscribe for only the next published event of this type. The subscription removes itself after
+        //it is called, so there is no need to capture the SubscriptionID and unsub from inside the callback.
+        //The returned ID can still be used to unsub before the event is ever published.
+        template <typename EventType>
+        SubscriptionID subOnce(OnEventCallback callback)
+        {
+            return addSubscription<EventType>(std::move(callback), 1);
+        }
+
+        //Same as subOnce but for the next callCount events of this type.
+        //Returns INVALID_SUBSCRIPTION_ID if callCount is 0.
+        template <typename EventType>
+        SubscriptionID subN(OnEventCallback callback, std::uint32_t callCount)
+        {
+            if(callCount == 0)
+                return INVALID_SUBSCRIPTION_ID;
+
+            return addSubscription<EventType>(std::move(callback), callCount);
+        }
+
+        //Subscribe to every event type that is in any of the categories in mask (see CategoryOf) with one callback.
+        //The subscription is added to each of those types' lists right here, so publishing costs the same as if 
+        //it had been made with sub once per type. They all share the returned ID, undo it with unsubCategory.
+        //Returns INVALID_SUBSCRIPTION_ID if no event type is in mask. options.mailboxCapacity must be 0.
+        [[nodiscard]] SubscriptionID subCategory(EventCategoryMask mask, OnEventCallback callback, SubscriptionOptions const& options = {})
+        {
+            assert(options.mailboxCapacity == 0 && "category subscriptions cant have a mailbox");
+
+            if(!((!IsCompiledOutEvent<EventTs> && (CategoryOf<EventTs> & mask) != 0) || ...))
+                return INVALID_SUBSCRIPTION_ID;
+
+            auto const subID { nextSubscriptionID() };
+
+            ([&]
+            {
+                if constexpr(!IsCompiledOutEvent<EventTs> && CategoryOf<EventTs> != 0)
+                {
+                    if((CategoryOf<EventTs> & mask) != 0)
+                        addSubscription<EventTs>(callback, UNLIMITED_CALLS, options, subID, true);
+                }
+            }(), ...);
+
+            return subID;
+        }
+
+        //Undo a subCategory. Resets subID to INVALID_SUBSCRIPTION_ID and returns true if it was successful.
+        bool unsubCategory(SubscriptionID& subID)
+        {
+            if(INVALID_SUBSCRIPTION_ID == subID)
+                return false;
+
+            bool wasSuccessful {false};
+
+            ([&]
+            {
+                if constexpr(!IsCompiledOutEvent<EventTs> && CategoryOf<EventTs> != 0)
+                    wasSuccessful = unsub(subID, typeid(EventTs), true) || wasSuccessful;
+            }(), ...);
+
+            if(wasSuccessful)
+                subID = INVALID_SUBSCRIPTION_ID;
+
+            return wasSuccessful;
+        }
+
+        //Subscribe to EventTypes that are published with Publisher::pubTo for this entity only.
+        //Normal pub does not reach these, and pubTo does not reach normal subscriptions.
+        template <typename EventType>
+        [[nodiscard]] SubscriptionID subTo(EntityID entity, OnEventCallback callback)
+        {
+            static_assert
+            (
+                IsTypeInPack<EventType, EventTs...>, 
+                "The template type paramater passed to"
+                " EventSystem::Subscriber::subTo was not a valid event type for this EventSystem."
+            );
+
+            if constexpr(IsCompiledOutEvent<EventType>)
+            {
+                return INVALID_SUBSCRIPTION_ID;
+            }
+            else
+            {
+                auto const subID { nextSubscriptionID() };
+                mThisEventSys.template entitySubscribersOf<EventType>().add(entity, std::move(callback), subID);
+                return subID;
+            }
+        }
+
+        //Make room for subscriptionCount subTo subscriptions to EventType up front.
+        template <typename EventType>
+        void reserveSubTo(std::size_t subscriptionCount)
+        {
+            static_assert
+            (
+                IsTypeInPack<EventType, EventTs...>, 
+                "The template type paramater passed to"
+                " EventSystem::Subscriber::reserveSubTo was not a valid event type for this EventSystem."
+            );
+
+            if constexpr(!IsCompiledOutEvent<EventType>)
+                mThisEventSys.template entitySubscribersOf<EventType>().reserve(subscriptionCount);
+        }
+
+        //Undo a subTo. Resets subID to INVALID_SUBSCRIPTION_ID and returns true if it was successful.
+        template <typename EventType>
+        bool unsubTo(EntityID entity, SubscriptionID& subID)
+        {
+            static_assert
+            (
+                IsTypeInPack<EventType, EventTs...>, 
+                "The template type paramater passed to"
+                " EventSystem::Subscriber::unsubTo was not a valid event type for this EventSystem."
+            );
+
+            if constexpr(IsCompiledOutEvent<EventType>)
+            {
+                return false;
+            }
+            else
+            {
+                if(INVALID_SUBSCRIPTION_ID == subID)
+                    return false;
+
+                bool const wasSuccessful { mThisEventSys.template entitySubscribersOf<EventType>().remove(entity, subID) };
+
+                if(wasSuccessful)
+                    subID = INVALID_SUBSCRIPTION_ID;
+
+                return wasSuccessful;
+            }
+        }
+
+        //Keep projection up to date with every published EventType. fold(State&, EventType const&) updates the
+        //state in place (see countByKey, latestByKey and topN). One projection can be fed by several event types 
+        //by calling project once per type. The projection must outlive the returned subscription.
+        template <typename EventType, typename State, typename Fold>
+        [[nodiscard]] SubscriptionID project(Projection<State>& projection, Fold fold)
+        {
+            return sub<EventType>([&projection, fold = std::move(fold)](Event const& e) mutable
+            {
+                projection.apply(fold, e.template unpack<EventType>());
+            });
+        }
+
+        //Swap the callback of a subscription for callback, keeping its ID, its place in the call order and its options,
+        //for reloading handlers without them moving. The list itself is not touched so this doesnt allocate. 
+        //A callback can replace itself, the old one is destroyed once the dispatch it is running in is over. 
+        //Offloaded and mailbox calls already running finish with the old callback, events waiting in a mailbox get 
+        //the new one. Returns false if there is no such subscription.
+        template <typename EventType>
+        bool replace(SubscriptionID subID, OnEventCallback callback)
+        {
+            static_assert
+            (
+                IsTypeInPack<EventType, EventTs...>, 
+                "The template type paramater passed to"
+                " EventSystem::Subscriber::replace was not a valid event type for this EventSystem."
+            );
+
+            if constexpr(IsCompiledOutEvent<EventType>)
+            {
+                return false;
+            }
+            else
+            {
+                auto& subscriberList { mThisEventSys.template subscribersOf<EventType>() };
+                auto const subIt { subscriberList.find(subID) };
+                bool const isPending { subIt == subscriberList.subscriptions.end() };
+
+                Subscription* subscription { isPending ? nullptr : &*subIt };
+                if(isPending)
+                {
+                    auto const pendingIt { std::ranges::find(subscriberList.pendingSubscriptions, subID, &Subscription::ID) };
+                    if(pendingIt != subscriberList.pendingSubscriptions.end())
+                        subscription = &*pendingIt;
+                }
+
+                if(subscription == nullptr || std::atomic_ref{subscription->remainingCalls}.load(std::memory_order_relaxed) == 0)
+                    return false;
+
+                if(subscription->offload)
+                    subscription->offload->callback.replace(callback);
+                else if(subscription->mailbox)
+                    subscription->mailbox->callback.replace(callback);
+
+                std::swap(subscription->callback, callback);
+
+                //callback is the old one now, it might be what is running
+                if(subscriberList.dispatchDepth > 0 && !isPending)
+                    subscriberList.retiredCallbacks.push_back(std::move(callback));
+
+                return true;
+            }
+        }
+
+        //Thread safe. Same as sub, but the subscription is only added at the next combine point: the start of 
+        //EventSystem::dispatchQueued/dispatchQueuedParallel, or EventSystem::applyConcurrentSubscriptions. 
+        //Every sub/unsubConcurrent made from any thread by then is applied in one pass, which makes mass subscribing 
+        //from worker threads cheap. The returned ID is valid right away, for unsubConcurrent or for after.
+        template <typename EventType>
+        [[nodiscard]] SubscriptionID subConcurrent(OnEventCallback callback, SubscriptionOptions options = {})
+        {
+            static_assert
+            (
+                IsTypeInPack<EventType, EventTs...>, 
+                "The template type paramater passed to"
+                " EventSystem::Subscriber::subConcurrent was not a valid event type for this EventSystem."
+            );
+
+            if constexpr(IsCompiledOutEvent<EventType>)
+            {
+                return INVALID_SUBSCRIPTION_ID;
+            }
+            else
+            {
+                auto const subID { nextSubscriptionID() };
+                pushMutation({subID, &Subscriber::addSubscription<EventType>, typeid(EventType), std::move(callback), std::move(options)});
+                return subID;
+            }
+        }
+
+        //Thread safe. Same as unsub, applied at the next combine point like subConcurrent. 
+        //Resets subID to INVALID_SUBSCRIPTION_ID and returns false if it already was.
+        template <typename EventType>
+        bool unsubConcurrent(SubscriptionID& subID)
+        {
+            static_assert
+            (
+                IsTypeInPack<EventType, EventTs...>, 
+                "The template type paramater passed to"
+                " EventSystem::Subscriber::unsubConcurrent was not a valid event type for this EventSystem."
+            );
+
+            if(IsCompiledOutEvent<EventType> || INVALID_SUBSCRIPTION_ID == subID)
+                return false;
+
+            pushMutation({std::exchange(subID, INVALID_SUBSCRIPTION_ID), nullptr, typeid(EventType), {}, {}});
+            return true;
+        }
+
+        //Returns true if a subscription callback was successfully removed from the event system otherwise returns false.
+        //Takes subID as a reference because if the unsubscription is successful then it resets the id to INVALID_SUBSCRIPTION_ID
+        //IDs from subCategory are rejected (asserting in debug builds), use unsubCategory for those.
+        template <typename EventType>
+        bool unsub(SubscriptionID& subID)
+        {
+            static_assert
+            (
+                IsTypeInPack<EventType, EventTs...>, 
+                "The template type paramater passed to"
+                " EventSystem::Subscriber::unsub was not a valid event type for this EventSystem."
+            );
+
+            if(IsCompiledOutEvent<EventType> || INVALID_SUBSCRIPTION_ID == subID)
+                return false;
+
+            bool const wasSuccessful { unsub(subID, typeid(EventType)) };
+
+            if(wasSuccessful)
+                subID = INVALID_SUBSCRIPTION_ID;
+
+            return wasSuccessful;
+        }
+
+    private:
+
+        template <typename Enum, typename>
+        requires std::is_enum_v<Enum>
+        friend class SubscriptionManager;
+
+        template <typename EventType>
+        SubscriptionID addSubscription(OnEventCallback callback, std::uint32_t remainingCalls, 
+            SubscriptionOptions const& options = {}, SubscriptionID subID = INVALID_SUBSCRIPTION_ID, bool isCategory = false)
+        {
+            static_assert
+            (
+                IsTypeInPack<EventType, EventTs...>, 
+                "The template type paramater passed to"
+                " EventSystem::Subscriber::sub was not a valid event type for this EventSystem."
+            );
+
+            if constexpr(IsCompiledOutEvent<EventType>)
+            {
+                return INVALID_SUBSCRIPTION_ID;
+            }
+            else
+            {
+                auto& subscriberList { mThisEventSys.template subscribersOf<EventType>() };
+                assert(subscriberList.sharedDispatchCount.load(std::memory_order_relaxed) == 0 && "subscriptions cant change while a ShardedDispatcher publishes them");
+                subscriberList.compact();
+
+                std::shared_ptr<OffloadState> offload;
+                std::shared_ptr<Mailbox> mailbox;
+
+                assert(!(options.allowOffload && options.mailboxCapacity > 0) && "a subscription with a mailbox cant also be offloaded");
+
+                if(options.allowOffload || options.mailboxCapacity > 0)
+                {
+                    if constexpr(std::is_copy_constructible_v<EventType>)
+                    {
+                        if(options.allowOffload)
+                            offload = std::make_shared<OffloadState>(callback, &copyEvent<EventType>, &mThisEventSys.mOffloading);
+                        else
+                            mailbox = Mailbox::make(callback, &copyEvent<EventType>, options);
+                    }
+                    else
+                    {
+                        assert(false && "only subscriptions to copyable event types can be offloaded or have a mailbox");
+                    }
+                }
+
+                //subCategory passes in the ID it shares between lists
+                if(INVALID_SUBSCRIPTION_ID == subID)
+                    subID = nextSubscriptionID();
+
+                //appending to subscriptions while it is being dispatched could move the callback that is running
+                auto& subscriptions { subscriberList.dispatchDepth > 0 ? subscriberList.pendingSubscriptions : subscriberList.subscriptions };
+                auto const& subscription { subscriptions.emplace_back(std::move(callback), subID, remainingCalls, isCategory, 
+                    options.reads, options.writes, std::move(offload), std::move(mailbox)) };
+
+                for(auto const before : options.after)
+                    subscriberList.dependencies.emplace_back(before, subID);
+
+                if(SubscriberList::isSpecial(subscription) || !options.after.empty())
+                    subscriberList.specialCases |= SubscriberList::HAS_SPECIAL_SUBSCRIPTIONS;
+
+                subscriberList.onSubscriptionsChanged();
+
+                return subID;
+            }
+        }
+
+        //Overload to take a type_index instead of being templated on EventType.
+        //This is meant to be called from SubscriptionManager only.
+        //isCategory is true only for unsubCategory, the other unsubs cant remove a subCategory subscription.
+        bool unsub(SubscriptionID subID, std::type_index eventTypeIdx, bool isCategory = false)
+        {
+            if(auto* subscriberListPtr { mThisEventSys.subscribersOf(eventTypeIdx) })
+            {
+                auto& subscriberList { *subscriberListPtr };
+                auto& subscriptions { subscriberList.subscriptions };
+
+                //removing a subCategory subscription from just this list would orphan its copies in the others
+                auto const isSameKind = [isCategory](Subscription const& subscription)
+                {
+                    assert(subscription.isCategory == isCategory && "undo a subCategory with unsubCategory, and only that");
+                    return subscription.isCategory == isCategory;
+                };
+
+                auto subIt { subscriberList.find(subID) };
+
+                //made during a dispatch that is still running, it has never been called so it can just go
+                if(subIt == subscriptions.end())
+                {
+                    auto const pendingIt { std::ranges::find(subscriberList.pendingSubscriptions, subID, &Subscription::ID) };
+                    if(pendingIt == subscriberList.pendingSubscriptions.end() || !isSameKind(*pendingIt))
+                        return false;
+
+                    return subscriberList.removePending(subID);
+                }
+
+                if(!isSameKind(*subIt))
+                    return false;
+
+                //tombstones have already been removed as far as the user is concerned
+                if(std::atomic_ref{subIt->remainingCalls}.load(std::memory_order_relaxed) == 0)
+                    return false;
+
+                assert(subscriberList.sharedDispatchCount.load(std::memory_order_relaxed) == 0 && "subscriptions cant change while a ShardedDispatcher publishes them");
+
+                //A callback is unsubscribing while the list is being dispatched (possibly itself).
+                //Erasing now would shift elements out from under the dispatch loop, so tombstone it instead.
+                if(subscriberList.dispatchDepth > 0)
+                {
+                    std::atomic_ref{subIt->remainingCalls}.store(0, std::memory_order_relaxed);
+                    subscriberList.tombstoneCount.fetch_add(1, std::memory_order_relaxed);
+                    return true;
+                }
+
+                subscriptions.erase(subIt);
+
+                std::erase_if(subscriberList.dependencies, [subID](auto const& edge)
+                {
+                    return edge.first == subID || edge.second == subID;
+                });
+
+                subscriberList.compact();
+                subscriberList.updateSpecialSubscriptions();
+                subscriberList.onSubscriptionsChanged();
+
+                return true;
+            }
+
+            return false;
+        }
+
+        //A subConcurrent or unsubConcurrent waiting for the next combine point.
+        struct Mutation
+        {
+            using AddSubscription = SubscriptionID (Subscriber::*)(OnEventCallback, std::uint32_t, SubscriptionOptions const&, SubscriptionID, bool);
+
+            SubscriptionID ID;
+            AddSubscription add; //nullptr for an unsub
+            std::type_index eventType;
+            OnEventCallback callback;
+            SubscriptionOptions options;
+        };
+
+        //Threads are spread over these by their ID, so threads only contend for a slot with the few others that hash to it.
+        struct alignas(64) MutationSlot
+        {
+            std::mutex mutex;
+            std::vector<Mutation> mutations;
+        };
+
+        static constexpr std::size_t MUTATION_SLOT_COUNT {16};
+
+        SubscriptionID nextSubscriptionID()
+        {
+            return mNextSubscriptionID.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        void pushMutation(Mutation mutation)
+        {
+            auto& slot { mMutationSlots[std::hash<std::thread::id>{}(std::this_thread::get_id()) % MUTATION_SLOT_COUNT] };
+            {
+                std::scoped_lock lock {slot.mutex};
+                slot.mutations.push_back(std::move(mutation));
+            }
+
+            mPendingMutationCount.fetch_add(1, std::memory_order_release);
+        }
+
+        //Apply everything sub/unsubConcurrent have queued up, in one pass. Each list is compacted and has its
+        //dependency graph rebuilt once at the end however many of its subscriptions changed.
+        void applyMutations()
+        {
+            if(mPendingMutationCount.load(std::memory_order_acquire) == 0)
+                return;
+
+            //a callback is running, wait for the next combine point
+            auto& subscriberLists { mThisEventSys.mSubscriberLists };
+            if(std::ranges::any_of(subscriberLists, [](auto const& list){ return list.dispatchDepth > 0; }))
+                return;
+
+            mCombinedMutations.clear();
+
+            for(auto& slot : mMutationSlots)
+            {
+                std::scoped_lock lock {slot.mutex};
+                mPendingMutationCount.fetch_sub(slot.mutations.size(), std::memory_order_relaxed);
+                std::ranges::move(slot.mutations, std::back_inserter(mCombinedMutations));
+                slot.mutations.clear();
+            }
+
+            //subs first since an unsub can be in an earlier slot than the sub it undoes, and in ID order
+            //since that is the order the subscriptions were made in
+            auto const unsubs { std::ranges::stable_partition(mCombinedMutations, [](auto const& m){ return m.add != nullptr; }) };
+            std::ranges::sort(mCombinedMutations.begin(), unsubs.begin(), {}, &Mutation::ID);
+
+            //while the lists look like they are being dispatched, unsubs only tombstone and graph rebuilds wait
+            for(auto& subscriberList : subscriberLists)
+                ++subscriberList.dispatchDepth;
+
+            //these wait in pendingSubscriptions and are sorted in with the rest by endDispatch
+            for(auto it { mCombinedMutations.begin() }; it != unsubs.begin(); ++it)
+                (this->*it->add)(std::move(it->callback), UNLIMITED_CALLS, it->options, it->ID, false);
+
+            for(auto const& m : unsubs)
+                unsub(m.ID, m.eventType);
+
+            for(auto& subscriberList : subscriberLists)
+            {
+                mThisEventSys.endDispatch(subscriberList);
+                subscriberList.compact();
+            }
+
+            mCombinedMutations.clear();
+        }
+
+        friend class BasicEventSystem;
+        Subscriber(BasicEventSystem& thisEventSys) : mThisEventSys{thisEventSys} {}
+
+        BasicEventSystem& mThisEventSys;
+
+        //start at 1 because INVALID_SUBSCRIPTION_ID is 0
+        std::atomic<SubscriptionID> mNextSubscriptionID {1};
+
+        //see subConcurrent
+        std::array<MutationSlot, MUTATION_SLOT_COUNT> mMutationSlots;
+        std::atomic<std::size_t> mPendingMutationCount {0};
+        std::vector<Mutation> mCombinedMutations; //reused by every applyMutations
+    };
+
+private:
+    struct SubscriberList;
+
+public:
+    //See Publisher::channel.
+    template <typename EventType>
+    class Channel
+    {
+    public:
+        void pub(EventType& e) const
+        {
+            if constexpr(!IsCompiledOutEvent<EventType>)
+            {
+                if(!mEventSys->isDuplicate(e))
+                    mEventSys->publish(e, *mSubscribers);
+            }
+        }
+
+        [[nodiscard]] SubscriptionID sub(OnEventCallback callback) const
+        {
+            return mEventSys->mSubscriber.template addSubscription<EventType>(std::move(callback), UNLIMITED_CALLS);
+        }
+
+    private:
+        friend class BasicEventSystem;
+        Channel(BasicEventSystem& eventSys) 
+            : mEventSys{&eventSys}
+        {
+            if constexpr(!IsCompiledOutEvent<EventType>)
+                mSubscribers = &eventSys.template subscribersOf<EventType>();
+        }
+
+        BasicEventSystem* mEventSys;
+        SubscriberList* mSubscribers {nullptr}; //stays nullptr for a compiled out EventType
+    };
+
+    struct Publisher
+    {
+        template <typename EventType>
+        void pub(EventType& e) const
+        {
+            static_assert
+            (
+                IsTypeInPack<EventType, EventTs...>,
+                "The template type paramater passed to"
+                " EventSystem::pub was not a valid event type for this EventSystem."
+            );
+
+            if constexpr(!IsCompiledOutEvent<EventType>)
+            {
+                if(!mThisEventSys.isDuplicate(e))
+                    mThisEventSys.publish(e, mThisEventSys.template subscribersOf<EventType>());
+            }
+        }
+
+        //Publish e with its subscriptions running on pool at the same time, wherever their SubscriptionOptions::after
+        //dependencies allow it. A subscription still only starts once everything it depends on has returned.
+        //Returns after every subscription has been called. Callbacks can unsub during this but must not sub or replace.
+        template <typename EventType>
+        void pubParallel(EventType& e, ThreadPool& pool) const
+        {
+            static_assert
+            (
+                IsTypeInPack<EventType, EventTs...>,
+                "The template type paramater passed to"
+                " EventSystem::pubParallel was not a valid event type for this EventSystem."
+            );
+
+            if constexpr(!IsCompiledOutEvent<EventType>)
+            {
+                if(!mThisEventSys.isDuplicate(e))
+                    mThisEventSys.publishParallel(e, mThisEventSys.template subscribersOf<EventType>(), pool);
+            }
+        }
+
+        //Thread safe, for publishing EventType from several threads at once, which is what ShardedDispatcher does.
+        //The subscriptions to EventType are called on the calling thread so they must be thread safe, they must
+        //not be changed meanwhile, and they should only publish with pubShared or enqueue. pause doesnt hold these.
+        template <typename EventType>
+        void pubShared(EventType& e) const
+        {
+            static_assert
+            (
+                IsTypeInPack<EventType, EventTs...>,
+                "The template type paramater passed to"
+                " EventSystem::pubShared was not a valid event type for this EventSystem."
+            );
+
+            if constexpr(!IsCompiledOutEvent<EventType>)
+            {
+                if(!mThisEventSys.isDuplicate(e))
+                    mThisEventSys.publishShared(e, mThisEventSys.template subscribersOf<EventType>());
+            }
+        }
+
+        //Deliver e only to the subscriptions made with Subscriber::subTo for this entity, in O(1).
+        template <typename EventType>
+        void pubTo(EntityID entity, EventType& e) const
+        {
+            static_assert
+            (
+                IsTypeInPack<EventType, EventTs...>,
+                "The template type paramater passed to"
+                " EventSystem::pubTo was not a valid event type for this EventSystem."
+            );
+
+            if constexpr(!IsCompiledOutEvent<EventType>)
+            {
+                if(mThisEventSys.isDuplicate(e))
+                    return;
+
+                mThisEventSys.callPublishHook(e);
+                mThisEventSys.template entitySubscribersOf<EventType>().dispatch(entity, e);
+            }
+        }
+
+        //A handle that publishes and subscribes to EventType without looking anything up.
+        //Hot publishers can hold one per event type. It is valid for the lifetime of the EventSystem.
+        template <typename EventType>
+        [[nodiscard]] Channel<EventType> channel() const
+        {
+            static_assert
+            (
+                IsTypeInPack<EventType, EventTs...>,
+                "The template type paramater passed to"
+                " EventSystem::channel was not a valid event type for this EventSystem."
+            );
+
+            return Channel<EventType>{mThisEventSys};
+        }
+
+        //Construct the event in place from args and publish it.
+        //For compiled out event types the event is never constructed.
+        template <typename EventType, typename... Args>
+        void emplacePub(Args&&... args) const
+        {
+            if constexpr(!IsCompiledOutEvent<EventType>)
+            {
+                EventType e(std::forward<Args>(args)...);
+                pub(e);
+            }
+        }
+
+        //Thread safe. Queue a copy of e to be published later by EventSystem::dispatchQueued.
+        template <typename EventType>
+        void enqueue(EventType e) const
+        {
+            static_assert
+            (
+                IsTypeInPack<EventType, EventTs...>,
+                "The template type paramater passed to"
+                " EventSystem::enqueue was not a valid event type for this EventSystem."
+            );
+
+            if constexpr(!IsCompiledOutEvent<EventType>)
+            {
+                if(!mThisEventSys.isDuplicate(e))
+                    mThisEventSys.pushQueued(std::move(e), INVALID_CORRELATION_ID);
+            }
+        }
+
+        //Thread safe. Same as enqueue, for an event that should be handled by deadline. dispatchQueued publishes events 
+        //with deadlines before anything else, earliest deadline first, and counts how many met or missed their
+        //deadline (see deadlineMetrics). Events without a deadline come after them, in the order they were enqueued.
+        //Keeping them ordered is a heap, so O(log n) per event.
+        template <typename EventType>
+        void enqueue(EventType e, std::chrono::steady_clock::time_point deadline, 
+            DeadlineMissPolicy policy = DeadlineMissPolicy::deliverLate) const
+        {
+            static_assert
+            (
+                IsTypeInPack<EventType, EventTs...>,
+                "The template type paramater passed to"
+                " EventSystem::enqueue was not a valid event type for this EventSystem."
+            );
+
+            if constexpr(!IsCompiledOutEvent<EventType>)
+            {
+                if(!mThisEventSys.isDuplicate(e))
+                    mThisEventSys.pushDeadlineEvent(std::move(e), deadline, policy);
+            }
+        }
+
+        //Start a group of related events (remove A, add B, ...) that dispatchQueued only ever publishes together:
+        //they are staged in the returned Batch without any locking and handed to the queue in one step by commit,
+        //so a consumer never sees part of them. Committing a batch takes the queue lock once for all of its events
+        //instead of once per enqueue. Keep the Batch around to reuse its memory.
+        auto beginBatch() const
+        {
+            return Batch{mThisEventSys};
+        }
+
+        //Publish req with a new correlation ID. The Resp that a responder sends back with reply() is not
+        //broadcast, it goes straight to onReply from inside dispatchQueued. If no reply arrives before the
+        //timeout, the request expires: onExpired is called (if given) and a late reply is dropped.
+        //A coroutine can be continued by resuming its handle from onReply/onExpired.
+        //The request slot comes from a fixed pool, so there is no allocation per request.
+        //Returns INVALID_CORRELATION_ID if MAX_PENDING_REQUESTS requests are already waiting.
+        //Must be called from the thread that calls dispatchQueued.
+        template <typename Req, typename Resp>
+        CorrelationID request(Req& req, OnEventCallback onReply, 
+            std::chrono::steady_clock::duration timeout, std::function<void()> onExpired = {}) const
+        {
+            static_assert
+            (
+                IsTypeInPack<Req, EventTs...> && IsTypeInPack<Resp, EventTs...>,
+                "The template type paramaters passed to"
+                " EventSystem::request were not valid event types for this EventSystem."
+            );
+
+            static_assert(std::is_base_of_v<RequestEvent, Req>, "Request event types must inherit from RequestEvent");
+
+            if constexpr(IsCompiledOutEvent<Req> || IsCompiledOutEvent<Resp>)
+            {
+                return INVALID_CORRELATION_ID;
+            }
+            else
+            {
+                auto const correlationID
+                {
+                    mThisEventSys.allocateRequest(IndexInPack<Resp, EventTs...>, 
+                        std::move(onReply), std::move(onExpired), std::chrono::steady_clock::now() + timeout)
+                };
+
+                if(correlationID != INVALID_CORRELATION_ID)
+                {
+                    req.correlationID = correlationID;
+                    pub(req);
+                }
+
+                return correlationID;
+            }
+        }
+
+        //Thread safe. Send resp back to the requester that published the request with this correlationID.
+        template <typename Resp>
+        void reply(CorrelationID correlationID, Resp resp) const
+        {
+            static_assert
+            (
+                IsTypeInPack<Resp, EventTs...>,
+                "The template type paramater passed to"
+                " EventSystem::reply was not a valid event type for this EventSystem."
+            );
+
+            if constexpr(!IsCompiledOutEvent<Resp>)
+            {
+                if(correlationID != INVALID_CORRELATION_ID)
+                    mThisEventSys.pushQueued(std::move(resp), correlationID);
+            }
+        }
+
+#ifndef _WIN32
+        //Async signal safe. Publish an EventType made from payload on the thread that calls dispatchSignalEvents.
+        //This only copies payload into a preallocated lock free queue and wakes the file descriptor returned by
+        //enableSignalPublishing, so it can be called from a signal handler (which pub can't, it allocates and calls
+        //arbitrary callbacks). EventType must be constructible from Payload, which must be trivially copyable.
+        //Returns false if the queue is full or signal publishing was not enabled, and the event is dropped.
+        //
+        //void onSignal(int signal) { gEventSys->getPublisher().pubFromSignal<SignalReceived>(signal); }
+        template <typename EventType, typename Payload>
+        bool pubFromSignal(Payload const& payload) const
+        {
+            static_assert
+            (
+                IsTypeInPack<EventType, EventTs...>,
+                "The template type paramater passed to"
+                " EventSystem::pubFromSignal was not a valid event type for this EventSystem."
+            );
+            static_assert(std::is_trivially_copyable_v<Payload>, "pubFromSignal can only carry a trivially copyable payload.");
+            static_assert(sizeof(Payload) <= MAX_SIGNAL_PAYLOAD_SIZE, "The payload passed to pubFromSignal is bigger than MAX_SIGNAL_PAYLOAD_SIZE.");
+            static_assert(std::is_same_v<Payload, NoSignalPayload> || std::is_constructible_v<EventType, Payload const&>,
+                "The event type passed to pubFromSignal can't be constructed from its payload.");
+
+            if constexpr(IsCompiledOutEvent<EventType>)
+                return true;
+            else
+                return mThisEventSys.pushSignalEvent(&BasicEventSystem::publishSignalEvent<EventType, Payload>, &payload, sizeof(Payload));
+        }
+
+        //Same as above for event types that carry nothing and are default constructed.
+        template <typename EventType>
+        bool pubFromSignal() const
+        {
+            return pubFromSignal<EventType>(NoSignalPayload{});
+        }
+#endif
+
+    private:
+
+        friend class BasicEventSystem;
+        Publisher(BasicEventSystem& thisEventSys) : mThisEventSys{thisEventSys} {}
+
+        //Not a reference to const since dispatching updates the call counts of subOnce/subN subscriptions.
+        BasicEventSystem& mThisEventSys;
+    };
+
+    friend struct Subscriber;
+    friend struct Publisher;
+
+private:
+    //Compiled out event types get no per type state (subscriber lists, queued events, ...), so that state is kept
+    //for the stored types only, at STORAGE_INDICES[IndexInPack] rather than at the type's position in EventTs.
+    static constexpr std::size_t NOT_STORED { SIZE_MAX };
+    static constexpr std::size_t STORED_TYPE_COUNT { (std::size_t{0} + ... + std::size_t{!IsCompiledOutEvent<EventTs>}) };
+
+    static constexpr std::array<std::size_t, sizeof...(EventTs)> STORAGE_INDICES = []
+    {
+        constexpr std::array<bool, sizeof...(EventTs)> isStored { !IsCompiledOutEvent<EventTs>... };
+        std::array<std::size_t, sizeof...(EventTs)> indices {};
+        std::size_t storageIndex {0};
+
+        for(std::size_t i{0}; i < indices.size(); ++i)
+            indices[i] = isStored[i] ? storageIndex++ : NOT_STORED;
+
+        return indices;
+    }();
+
+    template <typename EventType>
+    requires (!IsCompiledOutEvent<EventType>)
+    static constexpr std::size_t StorageIndexOf { STORAGE_INDICES[IndexInPack<EventType, EventTs...>] };
+
+    //What an EventQueue keeps the events of one type in, nothing for compiled out types since they are never queued.
+    template <typename EventType>
+    struct NoEvents {};
+
+    template <typename EventType>
+    using QueuedEvents = std::conditional_t<IsCompiledOutEvent<EventType>, NoEvents<EventType>, std::vector<EventType>>;
+
+    template <typename EventType>
+    using DeadlineSlots = std::conditional_t<IsCompiledOutEvent<EventType>, NoEvents<EventType>, std::vector<std::optional<EventType>>>;
+
+    struct Offloading
+    {
+        ThreadPool* pool {nullptr};
+        std::chrono::nanoseconds threshold {0};
+    };
+
+    //A callback Subscriber::replace can swap while it is being called off the publishing thread (offloaded or in a mailbox).
+    class SwappableCallback
+    {
+    public:
+        SwappableCallback(OnEventCallback callback) : mCallback{std::make_shared<OnEventCallback const>(std::move(callback))} {}
+
+        void operator()(Event const& e) const
+        {
+            auto const callback { current() };
+            (*callback)(e);
+        }
+
+        //calls already running hold on to the old callback, whichever finishes last destroys it
+        void replace(OnEventCallback callback)
+        {
+            auto next { std::make_shared<OnEventCallback const>(std::move(callback)) };
+
+            std::scoped_lock lock {mMutex};
+            mCallback.swap(next);
+        }
+
+    private:
+        std::shared_ptr<OnEventCallback const> current() const
+        {
+            std::scoped_lock lock {mMutex};
+            return mCallback;
+        }
+
+        mutable std::mutex mMutex;
+        std::shared_ptr<OnEventCallback const> mCallback;
+    };
+
+    //Shared by an offloadable subscription and its calls that are running on the pool, 
+    //so those can finish even if the subscription is removed in the meantime.
+    struct OffloadState
+    {
+        static constexpr double SMOOTHING {0.2};
+
+        //time the call and fold it into the moving average
+        void callAndMeasure(Event const& e)
+        {
+            auto const startTime { std::chrono::steady_clock::now() };
+            callback(e);
+            auto const sample { static_cast<double>((std::chrono::steady_clock::now() - startTime) / std::chrono::nanoseconds{1}) };
+
+            //calls on the pool can race here, losing a sample now and then is fine for an average
+            auto const average { averageNanoseconds.load(std::memory_order_relaxed) };
+            averageNanoseconds.store(average == 0.0 ? sample : average + (sample - average) * SMOOTHING, std::memory_order_relaxed);
+        }
+
+        SwappableCallback callback;
+        std::shared_ptr<Event const>(*copyEvent)(Event const&);
+        Offloading const* offloading;
+
+        std::atomic<double> averageNanoseconds {0.0};
+        std::atomic<bool> isOffloaded {false};
+        std::atomic<std::uint64_t> offloadedCallCount {0};
+    };
+
+    template <typename EventType>
+    static std::shared_ptr<Event const> copyEvent(Event const& e)
+    {
+        return std::make_shared<EventType const>(e.template unpack<EventType>());
+    }
+
+    //A bounded queue of copies of events for one subscription, worked through in order by one thing at a time:
+    //on a pool, a drain task is submitted whenever it goes from empty to not, and handles a few events before 
+    //resubmitting itself so a busy mailbox cant keep a worker to itself. Otherwise a thread of its own waits on it.
+    struct Mailbox : std::enable_shared_from_this<Mailbox>
+    {
+        //events handled by one drain task on a pool before it makes way for other tasks
+        static constexpr std::size_t DRAIN_BATCH_SIZE {32};
+
+        static std::shared_ptr<Mailbox> make(OnEventCallback callback, std::shared_ptr<Event const>(*copyEvent)(Event const&), 
+            SubscriptionOptions const& options)
+        {
+            auto mailbox { std::make_shared<Mailbox>(std::move(callback), copyEvent, options) };
+
+            if(mailbox->pool == nullptr)
+                mailbox->worker = std::jthread{[&mailbox = *mailbox](std::stop_token stopToken){ mailbox.runWorker(stopToken); }};
+
+            return mailbox;
+        }
+
+        Mailbox(OnEventCallback callback, std::shared_ptr<Event const>(*copyEvent)(Event const&), SubscriptionOptions const& options)
+            : callback{std::move(callback)}, copyEvent{copyEvent}, capacity{options.mailboxCapacity},
+              overflow{options.mailboxOverflow}, pool{options.mailboxPool}
+        {
+        }
+
+        void post(Event const& e)
+        {
+            auto event { copyEvent(e) };
+
+            std::unique_lock lock {mutex};
+
+            if(events.size() >= capacity)
+            {
+                switch(overflow)
+                {
+                case MailboxOverflowPolicy::dropNewest:
+                    ++droppedCount;
+                    return;
+
+                case MailboxOverflowPolicy::dropOldest:
+                    events.pop_front();
+                    ++droppedCount;
+                    break;
+
+                case MailboxOverflowPolicy::block:
+                    hasRoom.wait(lock, [this]{ return events.size() < capacity; });
+                    break;
+                }
+            }
+
+            events.push_back(std::move(event));
+            ++postedCount;
+            maxDepth = std::max(maxDepth, events.size());
+
+            auto const needsDrainTask { pool != nullptr && !isDrainScheduled };
+            isDrainScheduled = isDrainScheduled || needsDrainTask;
+            lock.unlock();
+
+            if(needsDrainTask)
+                pool->submit([self = this->shared_from_this()]{ self->drainSome(); });
+            else if(pool == nullptr)
+                hasEvents.notify_one();
+        }
+
+        std::shared_ptr<Event const> tryPop()
+        {
+            std::scoped_lock lock {mutex};
+
+            if(events.empty())
+                return nullptr;
+
+            auto event { std::move(events.front()) };
+            events.pop_front();
+            hasRoom.notify_one();
+
+            return event;
+        }
+
+        void handle(Event const& e)
+        {
+            callback(e);
+
+            std::scoped_lock lock {mutex};
+            ++processedCount;
+        }
+
+        void drainSome()
+        {
+            for(std::size_t i{0}; i < DRAIN_BATCH_SIZE; ++i)
+            {
+                auto event { tryPop() };
+
+                if(!event)
+                {
+                    std::scoped_lock lock {mutex};
+
+                    //something might have been posted between the pop and the lock
+                    if(events.empty())
+                    {
+                        isDrainScheduled = false;
+                        return;
+                    }
+
+                    continue;
+                }
+
+                handle(*event);
+            }
+
+            pool->submit([self = this->shared_from_this()]{ self->drainSome(); });
+        }
+
+        void runWorker(std::stop_token stopToken)
+        {
+            for(;;)
+            {
+                {
+                    std::unique_lock lock {mutex};
+                    if(!hasEvents.wait(lock, stopToken, [this]{ return !events.empty(); }))
+                        return;
+                }
+
+                if(auto event { tryPop() })
+                    handle(*event);
+            }
+        }
+
+        MailboxMetrics metrics() const
+        {
+            std::scoped_lock lock {mutex};
+            return {events.size(), maxDepth, postedCount, processedCount, droppedCount};
+        }
+
+        SwappableCallback callback;
+        std::shared_ptr<Event const>(*copyEvent)(Event const&);
+        std::size_t capacity;
+        MailboxOverflowPolicy overflow;
+        ThreadPool* pool;
+
+        mutable std::mutex mutex;
+        std::condition_variable_any hasEvents;
+        std::condition_variable hasRoom;
+        std::deque<std::shared_ptr<Event const>> events;
+        bool isDrainScheduled {false};
+
+        std::size_t maxDepth {0};
+        std::uint64_t postedCount {0};
+        std::uint64_t processedCount {0};
+        std::uint64_t droppedCount {0};
+
+        std::jthread worker; //last so it is stopped and joined before anything else is destroyed
+    };
+
+    struct Subscription
+    {
+        OnEventCallback callback;
+        SubscriptionID  ID;
+
+        //Counted down by the dispatch loop for subOnce/subN subscriptions. Once it reaches 0 the
+        //subscription is a tombstone that dispatch skips over until the list is compacted.
+        std::uint32_t remainingCalls;
+
+        //made by subCategory, so it shares its ID with copies in other lists and only unsubCategory can undo it
+        bool isCategory {false};
+
+        ResourceSet reads {0};
+        ResourceSet writes {0};
+
+        //only for subscriptions that allow offloading, see enableOffloading
+        std::shared_ptr<OffloadState> offload {};
+
+        //only for subscriptions with a mailbox, see SubscriptionOptions::mailboxCapacity
+        std::shared_ptr<Mailbox> mailbox {};
+    };
+
+    //All of the subscriptions to one event type.
+    struct SubscriberList
+    {
+        //Call the subscription at index unless it is a tombstone, counting down subOnce/subN call counts.
+        void call(std::size_t index, Event const& e)
+        {
+            auto& subscription { subscriptions[index] };
+
+            //The same list can be dispatched on several threads at once so the call count is only touched atomically.
+            std::atomic_ref remainingCalls { subscription.remainingCalls };
+            auto calls { remainingCalls.load(std::memory_order_relaxed) };
+
+            //skip tombstones left behind by subOnce/subN or by an unsub during dispatch
+            if(calls == 0)
+                return;
+
+            if(calls != UNLIMITED_CALLS)
+            {
+                //claim one of the remaining calls, another thread might be racing for the last one
+                while(calls != 0 && !remainingCalls.compare_exchange_weak(calls, calls - 1, std::memory_order_relaxed)) {}
+
+                if(calls == 0)
+                    return;
+
+                if(calls == 1)
+                    tombstoneCount.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            if(subscription.mailbox)
+                subscription.mailbox->post(e);
+            else if(subscription.offload)
+                callOffloadable(*subscription.offload, subscription.offload, e);
+            else
+                subscription.callback(e);
+        }
+
+        //Decide where to run it from how long its calls have been taking, with some hysteresis 
+        //so one that costs about the threshold doesnt flip back and forth on every call.
+        static void callOffloadable(OffloadState& state, std::shared_ptr<OffloadState> const& statePtr, Event const& e)
+        {
+            auto const& offloading { *state.offloading };
+
+            if(offloading.pool == nullptr)
+            {
+                state.isOffloaded.store(false, std::memory_order_relaxed);
+                state.callAndMeasure(e);
+                return;
+            }
+
+            auto const average { state.averageNanoseconds.load(std::memory_order_relaxed) };
+            auto const threshold { static_cast<double>(offloading.threshold.count()) };
+            auto isOffloaded { state.isOffloaded.load(std::memory_order_relaxed) };
+
+            if(!isOffloaded && average > threshold)
+                isOffloaded = true;
+            else if(isOffloaded && average < threshold / 2.0)
+                isOffloaded = false;
+
+            state.isOffloaded.store(isOffloaded, std::memory_order_relaxed);
+
+            if(!isOffloaded)
+            {
+                state.callAndMeasure(e);
+                return;
+            }
+
+            state.offloadedCallCount.fetch_add(1, std::memory_order_relaxed);
+            offloading.pool->submit([statePtr, event = state.copyEvent(e)]
+            {
+                statePtr->callAndMeasure(*event);
+            });
+        }
+
+        //Remove a subscription made during the dispatch that is still running. Returns false if there is none with subID.
+        bool removePending(SubscriptionID subID)
+        {
+            auto const it { std::ranges::find(pendingSubscriptions, subID, &Subscription::ID) };
+            if(it == pendingSubscriptions.end())
+                return false;
+
+            pendingSubscriptions.erase(it);
+
+            std::erase_if(dependencies, [subID](auto const& edge)
+            {
+                return edge.first == subID || edge.second == subID;
+            });
+
+            updateSpecialSubscriptions();
+            onSubscriptionsChanged();
+            return true;
+        }
+
+        //Whether calling it takes more than checking it is not a tombstone.
+        static bool isSpecial(Subscription const& subscription)
+        {
+            auto const calls { subscription.remainingCalls };
+            return (calls != 0 && calls != UNLIMITED_CALLS) || subscription.mailbox || subscription.offload;
+        }
+
+        //Adding a subscription only ever sets HAS_SPECIAL_SUBSCRIPTIONS, after removing some it has to look at what is left.
+        void updateSpecialSubscriptions()
+        {
+            if(!(specialCases & HAS_SPECIAL_SUBSCRIPTIONS))
+                return;
+
+            if(dependencies.empty() && std::ranges::none_of(subscriptions, isSpecial) && std::ranges::none_of(pendingSubscriptions, isSpecial))
+                specialCases &= ~HAS_SPECIAL_SUBSCRIPTIONS;
+        }
+
+        //Move the subscriptions made during dispatch into subscriptions, once it is no longer being dispatched.
+        void addPendingSubscriptions()
+        {
+            if(pendingSubscriptions.empty())
+                return;
+
+            std::ranges::move(pendingSubscriptions, std::back_inserter(subscriptions));
+            pendingSubscriptions.clear();
+
+            //subConcurrent hands out IDs before its subscriptions are added, so these can be older than ones already here
+            if(!std::ranges::is_sorted(subscriptions, {}, &Subscription::ID))
+                std::ranges::stable_sort(subscriptions, {}, &Subscription::ID);
+
+            onSubscriptionsChanged();
+        }
+
+        //Subscriptions are always sorted by ID since IDs only go up and new ones are appended.
+        auto find(SubscriptionID subID)
+        {
+            auto const it { std::ranges::lower_bound(subscriptions, subID, {}, &Subscription::ID) };
+            return (it != subscriptions.end() && it->ID == subID) ? it : subscriptions.end();
+        }
+
+        //Remove tombstones. This only happens on sub/unsub and never while the list is being dispatched.
+        void compact()
+        {
+            if(dispatchDepth == 0 && tombstoneCount.load(std::memory_order_relaxed) > 0)
+            {
+                std::erase_if(subscriptions, [](auto const& sub){ return sub.remainingCalls == 0; });
+                tombstoneCount.store(0, std::memory_order_relaxed);
+
+                std::erase_if(dependencies, [this](auto const& edge)
+                {
+                    return find(edge.first) == subscriptions.end() || find(edge.second) == subscriptions.end();
+                });
+
+                updateSpecialSubscriptions();
+
+                onSubscriptionsChanged();
+            }
+        }
+
+        //The dependency graph only changes here, on sub/unsub. If that happens from a callback 
+        //the rebuild waits until the list is no longer being dispatched.
+        void onSubscriptionsChanged()
+        {
+            if(dependencies.empty() && graph.order.empty())
+                return;
+
+            if(dispatchDepth > 0)
+                isGraphStale = true;
+            else
+                rebuildGraph();
+        }
+
+        //Topologically sort the subscriptions by their dependencies (Kahn's algorithm). 
+        //Subscriptions that are not ordered relative to each other stay in the order they were made.
+        void rebuildGraph()
+        {
+            isGraphStale = false;
+
+            auto const count { subscriptions.size() };
+            graph.order.clear();
+            graph.successors.assign(count, {});
+            graph.dependencyCounts.assign(count, 0);
+
+            if(dependencies.empty())
+                return;
+
+            for(auto const& [before, after] : dependencies)
+            {
+                auto const beforeIt { find(before) }, afterIt { find(after) };
+
+                //ignore dependencies on subscriptions to other event types
+                if(beforeIt == subscriptions.end() || afterIt == subscriptions.end() || beforeIt == afterIt)
+                    continue;
+
+                auto const afterIndex { static_cast<std::uint32_t>(afterIt - subscriptions.begin()) };
+                graph.successors[beforeIt - subscriptions.begin()].push_back(afterIndex);
+                ++graph.dependencyCounts[afterIndex];
+            }
+
+            auto remaining { graph.dependencyCounts };
+            for(std::uint32_t i{0}; i < count; ++i)
+            {
+                if(remaining[i] == 0)
+                    graph.order.push_back(i);
+            }
+
+            for(std::size_t head{0}; head < graph.order.size(); ++head)
+            {
+                for(auto const successor : graph.successors[graph.order[head]])
+                {
+                    if(--remaining[successor] == 0)
+                        graph.order.push_back(successor);
+                }
+            }
+
+            graph.hasCycle = graph.order.size() != count;
+            assert(!graph.hasCycle && "the SubscriptionOptions::after dependencies of this event type form a cycle");
+
+            //with a cycle, the subscriptions in it are still called, just in the order they were made
+            for(std::uint32_t i{0}; graph.hasCycle && i < count; ++i)
+            {
+                if(remaining[i] > 0)
+                    graph.order.push_back(i);
+            }
+        }
+
+        std::vector<Subscription> subscriptions;
+
+        //Subscriptions made while the list is being dispatched, see addPendingSubscriptions.
+        std::vector<Subscription> pendingSubscriptions;
+
+        //atomic since the pool threads of pubParallel/dispatchQueuedParallel can use up the last call of subN subscriptions
+        std::atomic<std::size_t> tombstoneCount {0};
+
+        //How many pub calls are currently looping over this list. Only the thread that owns the 
+        //EventSystem touches it, a callback can publish the same type again.
+        std::uint32_t dispatchDepth {0};
+
+        //How many ShardedDispatcher workers are publishing this list right now, see Publisher::pubShared.
+        std::atomic<std::uint32_t> sharedDispatchCount {0};
+
+        //Publishing a list with neither of these set checks that once, instead of checking whether the type 
+        //is paused and every subscription for a call limit, a mailbox or offloading.
+        static constexpr std::uint8_t IS_PAUSED {1};
+        static constexpr std::uint8_t HAS_SPECIAL_SUBSCRIPTIONS {2}; //call limits, mailboxes, offloading or dependencies
+        std::uint8_t specialCases {0};
+
+        //{before, after} pairs from SubscriptionOptions::after.
+        std::vector<std::pair<SubscriptionID, SubscriptionID>> dependencies;
+
+        //Built from dependencies when the subscriptions change. Indices are into subscriptions.
+        struct DependencyGraph
+        {
+            std::vector<std::uint32_t> order;
+            std::vector<std::vector<std::uint32_t>> successors;
+            std::vector<std::uint32_t> dependencyCounts;
+            bool hasCycle {false};
+        };
+
+        DependencyGraph graph;
+        bool isGraphStale {false};
+
+        //callbacks swapped out by Subscriber::replace during a dispatch, which might still be running
+        std::vector<OnEventCallback> retiredCallbacks;
+    };
+
+    //Events waiting for dispatchQueued. Each event type is stored by value in its own vector so
+    //enqueueing stops allocating once the vectors have grown, and order remembers the order
+    //that the events were enqueued in across all of the types.
+    struct EventQueue
+    {
+        struct Entry
+        {
+            std::size_t   typeIndex;     //index of the event type in EventTs
+            std::size_t   eventIndex;    //index into the vector for that event type
+            CorrelationID correlationID; //INVALID_CORRELATION_ID unless this is a reply to a request
+            bool continuesBatch {false}; //true for every event of a committed Batch but its last
+        };
+
+        template <typename EventType>
+        void push(EventType e, CorrelationID correlationID)
+        {
+            constexpr auto typeIndex { IndexInPack<EventType, EventTs...> };
+            auto& typeEvents { std::get<typeIndex>(events) };
+            order.emplace_back(typeIndex, typeEvents.size(), correlationID);
+            typeEvents.push_back(std::move(e));
+        }
+
+        //Move everything in batch to the end of this, marked as one batch.
+        void append(EventQueue& batch)
+        {
+            auto const firstNewEntry { order.size() };
+            std::array<std::size_t, sizeof...(EventTs)> eventIndexOffsets;
+
+            [&]<std::size_t... Is>(std::index_sequence<Is...>)
+            {
+                ([&]
+                {
+                    if constexpr(!IsCompiledOutEvent<EventTs>)
+                    {
+                        auto& typeEvents { std::get<Is>(events) };
+                        auto& batchEvents { std::get<Is>(batch.events) };
+
+                        eventIndexOffsets[Is] = typeEvents.size();
+                        typeEvents.insert(typeEvents.end(), std::make_move_iterator(batchEvents.begin()), std::make_move_iterator(batchEvents.end()));
+                    }
+                }(), ...);
+            }(std::index_sequence_for<EventTs...>{});
+
+            for(auto const& entry : batch.order)
+                order.emplace_back(entry.typeIndex, entry.eventIndex + eventIndexOffsets[entry.typeIndex], entry.correlationID, true);
+
+            if(order.size() > firstNewEntry)
+                order.back().continuesBatch = false;
+
+            batch.clear();
+        }
+
+        void clear()
+        {
+            [&]<std::size_t... Is>(std::index_sequence<Is...>)
+            {
+                ([&]
+                {
+                    if constexpr(!IsCompiledOutEvent<EventTs>)
+                        std::get<Is>(events).clear();
+                }(), ...);
+            }(std::index_sequence_for<EventTs...>{});
+
+            order.clear();
+        }
+
+        std::tuple<QueuedEvents<EventTs>...> events;
+        std::vector<Entry> order;
+    };
+
+    //Events enqueued with a deadline, in a binary heap with the earliest deadline on top. The events themselves
+    //sit in per type slots that are reused once dispatched, so the heap entries stay small and nothing is
+    //allocated per event once it has grown.
+    struct DeadlineQueue
+    {
+        struct Entry
+        {
+            std::chrono::steady_clock::time_point deadline;
+            std::uint64_t sequence; //ties go to whichever was enqueued first
+            std::uint32_t typeIndex;
+            std::uint32_t slot;
+            DeadlineMissPolicy policy;
+        };
+
+        static bool isLater(Entry const& a, Entry const& b)
+        {
+            return a.deadline != b.deadline ? a.deadline > b.deadline : a.sequence > b.sequence;
+        }
+
+        template <typename EventType>
+        void push(EventType e, std::chrono::steady_clock::time_point deadline, DeadlineMissPolicy policy)
+        {
+            constexpr auto typeIndex { IndexInPack<EventType, EventTs...> };
+            auto& slots { std::get<typeIndex>(events) };
+            auto& freeSlots { freeSlotsOfType[StorageIndexOf<EventType>] };
+
+            std::uint32_t slot;
+            if(freeSlots.empty())
+            {
+                slot = static_cast<std::uint32_t>(slots.size());
+                slots.emplace_back(std::move(e));
+            }
+            else
+            {
+                slot = freeSlots.back();
+                freeSlots.pop_back();
+                slots[slot].emplace(std::move(e));
+            }
+
+            heap.emplace_back(deadline, nextSequence++, static_cast<std::uint32_t>(typeIndex), slot, policy);
+            std::ranges::push_heap(heap, isLater);
+        }
+
+        Entry pop()
+        {
+            std::ranges::pop_heap(heap, isLater);
+            auto const entry { heap.back() };
+            heap.pop_back();
+            return entry;
+        }
+
+        template <typename EventType>
+        EventType take(std::uint32_t slot)
+        {
+            auto& event { std::get<IndexInPack<EventType, EventTs...>>(events)[slot] };
+
+            EventType e { std::move(*event) };
+            event.reset();
+            freeSlotsOfType[StorageIndexOf<EventType>].push_back(slot);
+
+            return e;
+        }
+
+        std::tuple<DeadlineSlots<EventTs>...> events;
+        std::array<std::vector<std::uint32_t>, STORED_TYPE_COUNT> freeSlotsOfType;
+        std::vector<Entry> heap;
+        std::uint64_t nextSequence {0};
+    };
+
+    struct DeadlineCounters
+    {
+        std::atomic<std::uint64_t> metCount {0};
+        std::atomic<std::uint64_t> missedCount {0};
+        std::atomic<std::uint64_t> droppedCount {0};
+        std::atomic<std::uint64_t> heldCount {0};
+    };
+
+    enum class DeadlineDispatch { none, dispatched, dropped };
+
+public:
+    //See Publisher::beginBatch.
+    class Batch
+    {
+    public:
+        //Stage e. Nothing staged is visible to dispatchQueued until commit.
+        template <typename EventType>
+        void enqueue(EventType e)
+        {
+            static_assert
+            (
+                IsTypeInPack<EventType, EventTs...>,
+                "The template type paramater passed to"
+                " EventSystem::Batch::enqueue was not a valid event type for this EventSystem."
+            );
+
+            if constexpr(!IsCompiledOutEvent<EventType>)
+            {
+                if(!mEventSys->isDuplicate(e))
+                    mStaged.push(std::move(e), INVALID_CORRELATION_ID);
+            }
+        }
+
+        //Thread safe. Make everything staged visible to dispatchQueued at once, in the order it was staged.
+        //The batch is empty afterwards and can be reused. Returns how many events were committed.
+        std::size_t commit()
+        {
+            return mEventSys->commitBatch(mStaged);
+        }
+
+        //Drop everything staged since the last commit. A batch that is destroyed without committing does this too.
+        void discard() {mStaged.clear();}
+
+        std::size_t size() const {return mStaged.order.size();}
+
+    private:
+        friend class BasicEventSystem;
+        Batch(BasicEventSystem& eventSys) : mEventSys{&eventSys} {}
+
+        BasicEventSystem* mEventSys;
+        EventQueue mStaged;
+    };
+
+private:
+#ifndef _WIN32
+    struct NoSignalPayload {};
+
+    using SignalEventPublisher = void(*)(BasicEventSystem&, std::byte const* payload);
+
+    //A bounded multi producer queue (Dmitry Vyukov's) for Publisher::pubFromSignal. Pushing only uses lock free 
+    //atomics, memcpy and write, which are all safe in a signal handler, even one that interrupts another push.
+    //Every push then wakes a self pipe (an eventfd on Linux) so the owning thread knows to pop.
+    struct SignalQueue
+    {
+        static_assert(std::atomic<std::size_t>::is_always_lock_free, "pubFromSignal needs lock free atomics.");
+        static_assert(std::has_single_bit(SIGNAL_QUEUE_CAPACITY));
+
+        struct Slot
+        {
+            std::atomic<std::size_t> sequence;
+            SignalEventPublisher publish;
+            alignas(std::max_align_t) std::byte payload[MAX_SIGNAL_PAYLOAD_SIZE];
+        };
+
+        SignalQueue()
+        {
+            for(std::size_t i{0}; i < SIGNAL_QUEUE_CAPACITY; ++i)
+                slots[i].sequence.store(i, std::memory_order_relaxed);
+
+#ifdef __linux__
+            readFd = writeFd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            assert(readFd >= 0 && "pubFromSignal could not create its eventfd");
+#else
+            int fds[2] {-1, -1};
+            [[maybe_unused]] auto const result { ::pipe(fds) };
+            assert(result == 0 && "pubFromSignal could not create its pipe");
+
+            for(auto const fd : fds)
+            {
+                ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+                ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+            }
+
+            readFd = fds[0];
+            writeFd = fds[1];
+#endif
+        }
+
+        ~SignalQueue()
+        {
+            ::close(readFd);
+            if(writeFd != readFd)
+                ::close(writeFd);
+        }
+
+        bool push(SignalEventPublisher publish, void const* payload, std::size_t payloadSize)
+        {
+            auto position { enqueuePosition.load(std::memory_order_relaxed) };
+            Slot* slot;
+
+            for(;;)
+            {
+                slot = &slots[position & (SIGNAL_QUEUE_CAPACITY - 1)];
+                auto const sequence { slot->sequence.load(std::memory_order_acquire) };
+                auto const difference { static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position) };
+
+                if(difference == 0)
+                {
+                    if(enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                        break;
+                }
+                else if(difference < 0)
+                {
+                    droppedCount.fetch_add(1, std::memory_order_relaxed);
+                    return false;
+                }
+                else
+                {
+                    position = enqueuePosition.load(std::memory_order_relaxed);
+                }
+            }
+
+            slot->publish = publish;
+            std::memcpy(slot->payload, payload, payloadSize);
+            slot->sequence.store(position + 1, std::memory_order_release);
+
+            wakeUp();
+            return true;
+        }
+
+        //Only called by the owning thread.
+        bool popAndPublish(BasicEventSystem& eventSys)
+        {
+            auto& slot { slots[dequeuePosition & (SIGNAL_QUEUE_CAPACITY - 1)] };
+
+            if(slot.sequence.load(std::memory_order_acquire) != dequeuePosition + 1)
+                return false;
+
+            //copy out and free the slot before publishing, a callback could run long enough for it to be needed
+            auto const publish { slot.publish };
+            alignas(std::max_align_t) std::byte payload[MAX_SIGNAL_PAYLOAD_SIZE];
+            std::memcpy(payload, slot.payload, MAX_SIGNAL_PAYLOAD_SIZE);
+
+            slot.sequence.store(dequeuePosition + SIGNAL_QUEUE_CAPACITY, std::memory_order_release);
+            ++dequeuePosition;
+
+            publish(eventSys, payload);
+            return true;
+        }
+
+        void wakeUp() const
+        {
+            auto const savedErrno { errno };
+
+            std::uint64_t const one {1};
+            [[maybe_unused]] auto const result { ::write(writeFd, &one, writeFd == readFd ? sizeof(one) : 1) };
+
+            errno = savedErrno;
+        }
+
+        void clearWakeUp() const
+        {
+            std::uint64_t drained;
+            while(::read(readFd, &drained, sizeof(drained)) > 0) {}
+        }
+
+        std::array<Slot, SIGNAL_QUEUE_CAPACITY> slots;
+        std::atomic<std::size_t> enqueuePosition {0};
+        std::size_t dequeuePosition {0};
+        std::atomic<std::uint64_t> droppedCount {0};
+        int readFd {-1};
+        int writeFd {-1};
+    };
+
+    bool pushSignalEvent(SignalEventPublisher publish, void const* payload, std::size_t payloadSize)
+    {
+        //set by enableSignalPublishing before any handler could run, so a plain read is fine
+        return mSignalQueue && mSignalQueue->push(publish, payload, payloadSize);
+    }
+
+    template <typename EventType, typename Payload>
+    static void publishSignalEvent(BasicEventSystem& eventSys, std::byte const* payloadBytes)
+    {
+        Payload payload;
+        std::memcpy(&payload, payloadBytes, sizeof(Payload));
+
+        if constexpr(std::is_same_v<Payload, NoSignalPayload>)
+        {
+            EventType e {};
+            eventSys.mPublisher.pub(e);
+        }
+        else
+        {
+            EventType e {payload};
+            eventSys.mPublisher.pub(e);
+        }
+    }
+#endif
+
+    //A fixed size pool of requests waiting for a reply, allocated on the first request.
+    //A CorrelationID is the slot index + 1 in the low 16 bits and the generation of the slot in the
+    //high 16 bits, so a late reply to a slot that has since expired and been reused is ignored.
+    struct PendingRequests
+    {
+        static_assert(MAX_PENDING_REQUESTS < 0xFFFF);
+
+        struct Slot
+        {
+            OnEventCallback onReply;
+            std::function<void()> onExpired;
+            std::chrono::steady_clock::time_point expiry;
+            std::size_t responseTypeIndex {0};
+            std::uint16_t generation {0};
+            bool inUse {false};
+        };
+
+        PendingRequests()
+        {
+            for(std::size_t i{0}; i < MAX_PENDING_REQUESTS; ++i)
+                freeSlots[i] = static_cast<std::uint16_t>(MAX_PENDING_REQUESTS - 1 - i);
+        }
+
+        void release(std::size_t slotIndex)
+        {
+            auto& slot { slots[slotIndex] };
+            slot.onReply = nullptr;
+            slot.onExpired = nullptr;
+            slot.inUse = false;
+            ++slot.generation;
+            freeSlots[freeCount++] = static_cast<std::uint16_t>(slotIndex);
+        }
+
+        std::array<Slot, MAX_PENDING_REQUESTS> slots;
+        std::array<std::uint16_t, MAX_PENDING_REQUESTS> freeSlots;
+        std::size_t freeCount {MAX_PENDING_REQUESTS};
+    };
+
+    template <typename EventType>
+    void pushQueued(EventType e, CorrelationID correlationID)
+    {
+        {
+            std::scoped_lock lock {mQueueMutex};
+            mQueuedEvents.push(std::move(e), correlationID);
+        }
+
+        notifyQueued();
+    }
+
+    template <typename EventType>
+    void pushDeadlineEvent(EventType e, std::chrono::steady_clock::time_point deadline, DeadlineMissPolicy policy)
+    {
+        {
+            std::scoped_lock lock {mQueueMutex};
+            mDeadlineEvents.push(std::move(e), deadline, policy);
+            mDeadlineEventCount.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        notifyQueued();
+    }
+
+    void notifyQueued()
+    {
+        //skip the lock for the usual case of nothing being notified
+        if(!mHasQueueNotifier.load(std::memory_order_acquire))
+            return;
+
+        std::scoped_lock lock {mQueueNotifierMutex};
+        if(mQueueNotifier)
+            mQueueNotifier();
+    }
+
+    //Events with deadlines enqueued from here on wait for the next dispatch, like the others.
+    std::uint64_t nextDeadlineSequence()
+    {
+        if(mDeadlineEventCount.load(std::memory_order_relaxed) == 0)
+            return 0;
+
+        std::scoped_lock lock {mQueueMutex};
+        return mDeadlineEvents.nextSequence;
+    }
+
+    //Dispatch (or drop) the event with the earliest deadline, if it was enqueued before sequenceEnd.
+    DeadlineDispatch dispatchNextDeadlineEvent(std::uint64_t sequenceEnd)
+    {
+        //skip the lock entirely when nothing has a deadline, the usual case
+        if(mDeadlineEventCount.load(std::memory_order_relaxed) == 0)
+            return DeadlineDispatch::none;
+
+        typename DeadlineQueue::Entry entry;
+        {
+            std::scoped_lock lock {mQueueMutex};
+
+            if(mDeadlineEvents.heap.empty() || mDeadlineEvents.heap.front().sequence >= sequenceEnd)
+                return DeadlineDispatch::none;
+
+            entry = mDeadlineEvents.pop();
+            mDeadlineEventCount.fetch_sub(1, std::memory_order_relaxed);
+        }
+
+        static constexpr std::array dispatchers { &BasicEventSystem::dispatchDeadlineEvent<EventTs>... };
+        return (this->*dispatchers[entry.typeIndex])(entry);
+    }
+
+    template <typename EventType>
+    DeadlineDispatch dispatchDeadlineEvent(typename DeadlineQueue::Entry const& entry)
+    {
+        //compiled out types are never enqueued
+        if constexpr(IsCompiledOutEvent<EventType>)
+        {
+            return DeadlineDispatch::none;
+        }
+        else
+        {
+            auto e { [&]
+            {
+                std::scoped_lock lock {mQueueMutex};
+                return mDeadlineEvents.template take<EventType>(entry.slot);
+            }() };
+
+            auto& counters { mDeadlineCounters[StorageIndexOf<EventType>] };
+
+            if(entry.policy == DeadlineMissPolicy::drop && std::chrono::steady_clock::now() > entry.deadline)
+            {
+                counters.droppedCount.fetch_add(1, std::memory_order_relaxed);
+                return DeadlineDispatch::dropped;
+            }
+
+            //not handled yet, so neither met nor missed
+            if(subscribersOf<EventType>().specialCases != 0 && holdIfPaused(e))
+            {
+                counters.heldCount.fetch_add(1, std::memory_order_relaxed);
+                return DeadlineDispatch::dispatched;
+            }
+
+            publish(e, subscribersOf<EventType>());
+
+            if(std::chrono::steady_clock::now() > entry.deadline)
+                counters.missedCount.fetch_add(1, std::memory_order_relaxed);
+            else
+                counters.metCount.fetch_add(1, std::memory_order_relaxed);
+
+            return DeadlineDispatch::dispatched;
+        }
+    }
+
+    std::size_t commitBatch(EventQueue& batch)
+    {
+        auto const committedCount { batch.order.size() };
+        if(committedCount == 0)
+            return 0;
+
+        {
+            std::scoped_lock lock {mQueueMutex};
+            mQueuedEvents.append(batch);
+        }
+
+        notifyQueued();
+
+        return committedCount;
+    }
+
+    //Swap the queue into mDispatchingEvents, which must already be finished. Returns false if there was nothing queued.
+    bool takeQueuedEvents()
+    {
+        std::scoped_lock lock {mQueueMutex};
+        std::swap(mQueuedEvents, mDispatchingEvents);
+        return !mDispatchingEvents.order.empty();
+    }
+
+    void finishDispatchingQueued()
+    {
+        mDispatchingEvents.clear();
+        mDispatchCursor = 0;
+    }
+
+    //One call for dispatchQueuedParallel: a subscription for one of the queued events,
+    //or the static handlers/request continuation for that event.
+    struct BatchItem
+    {
+        static constexpr std::uint32_t RUN_ON_ITS_OWN { UINT32_MAX };
+
+        std::uint32_t wave;
+        std::uint32_t entryIndex;        //into mDispatchingEvents.order
+        std::uint32_t subscriptionIndex; //RUN_ON_ITS_OWN for static handlers and replies
+    };
+
+    //Put every call for the batch in mDispatchingEvents into the earliest wave that comes after every
+    //earlier call it conflicts with. For each resource, the end of the last wave that read it and of the
+    //last wave that wrote it are tracked, so placing a call is O(bits set) instead of comparing against every call.
+    void scheduleBatch()
+    {
+        mBatchItems.clear();
+        mBatchWaveOfSubscription.clear();
+
+        std::array<std::uint32_t, 64> lastReadEnd {}, lastWriteEnd {};
+        std::uint32_t waveCount {0}, barrierEnd {0};
+        std::vector<std::uint32_t> minWaveOf; //per subscription index of the current event, from "after" dependencies
+
+        auto const placeOnItsOwn = [&](std::uint32_t entryIndex)
+        {
+            mBatchItems.emplace_back(waveCount, entryIndex, BatchItem::RUN_ON_ITS_OWN);
+            barrierEnd = ++waveCount;
+        };
+
+        for(auto entryIndex { static_cast<std::uint32_t>(mDispatchCursor) }; entryIndex < mDispatchingEvents.order.size(); ++entryIndex)
+        {
+            auto const& entry { mDispatchingEvents.order[entryIndex] };
+
+            static constexpr std::array hasStaticHandlers { StaticHandlerList::template handles<EventTs>... };
+
+            if(entry.correlationID != INVALID_CORRELATION_ID || hasStaticHandlers[entry.typeIndex])
+                placeOnItsOwn(entryIndex);
+
+            if(entry.correlationID != INVALID_CORRELATION_ID)
+                continue;
+
+            auto& subscriberList { mSubscriberLists[STORAGE_INDICES[entry.typeIndex]] };
+            bool const hasDependencies { !subscriberList.dependencies.empty() };
+            auto const count { hasDependencies ? subscriberList.graph.order.size() : subscriberList.subscriptions.size() };
+
+            if(hasDependencies)
+                minWaveOf.assign(subscriberList.subscriptions.size(), 0);
+
+            for(std::size_t i{0}; i < count; ++i)
+            {
+                auto const index { hasDependencies ? subscriberList.graph.order[i] : static_cast<std::uint32_t>(i) };
+                auto const& subscription { subscriberList.subscriptions[index] };
+
+                if(std::atomic_ref{subscription.remainingCalls}.load(std::memory_order_relaxed) == 0)
+                    continue;
+
+                if(subscription.reads == 0 && subscription.writes == 0)
+                {
+                    placeOnItsOwn(entryIndex);
+                    mBatchItems.back().subscriptionIndex = index;
+                    mBatchWaveOfSubscription[subscription.ID] = mBatchItems.back().wave;
+                    continue;
+                }
+
+                auto wave { barrierEnd };
+
+                if(hasDependencies)
+                    wave = std::max(wave, minWaveOf[index]);
+
+                if(auto it { mBatchWaveOfSubscription.find(subscription.ID) }; it != mBatchWaveOfSubscription.end())
+                    wave = std::max(wave, it->second + 1);
+
+                for(auto bits { subscription.reads }; bits != 0; bits &= bits - 1)
+                    wave = std::max(wave, lastWriteEnd[std::countr_zero(bits)]);
+
+                for(auto bits { subscription.writes }; bits != 0; bits &= bits - 1)
+                    wave = std::max({wave, lastWriteEnd[std::countr_zero(bits)], lastReadEnd[std::countr_zero(bits)]});
+
+                for(auto bits { subscription.reads }; bits != 0; bits &= bits - 1)
+                    lastReadEnd[std::countr_zero(bits)] = std::max(lastReadEnd[std::countr_zero(bits)], wave + 1);
+
+                for(auto bits { subscription.writes }; bits != 0; bits &= bits - 1)
+                    lastWriteEnd[std::countr_zero(bits)] = wave + 1;
+
+                if(hasDependencies)
+                {
+                    for(auto const successor : subscriberList.graph.successors[index])
+                        minWaveOf[successor] = std::max(minWaveOf[successor], wave + 1);
+                }
+
+                mBatchItems.emplace_back(wave, entryIndex, index);
+                mBatchWaveOfSubscription[subscription.ID] = wave;
+                waveCount = std::max(waveCount, wave + 1);
+            }
+        }
+
+        std::ranges::stable_sort(mBatchItems, {}, &BatchItem::wave);
+    }
+
+    template <typename EventType>
+    void runBatchItem(BatchItem const& item)
+    {
+        if constexpr(!IsCompiledOutEvent<EventType>)
+        {
+            auto const& entry { mDispatchingEvents.order[item.entryIndex] };
+            auto& e { std::get<IndexInPack<EventType, EventTs...>>(mDispatchingEvents.events)[entry.eventIndex] };
+
+            if(entry.correlationID != INVALID_CORRELATION_ID)
+                completeRequest(entry.correlationID, IndexInPack<EventType, EventTs...>, e);
+            else if(item.subscriptionIndex == BatchItem::RUN_ON_ITS_OWN)
+                StaticHandlerList::dispatch(std::as_const(e));
+            else
+                subscribersOf<EventType>().call(item.subscriptionIndex, e);
+        }
+    }
+
+    template <typename EventType>
+    void dispatchQueuedEvent(typename EventQueue::Entry const& entry)
+    {
+        if constexpr(!IsCompiledOutEvent<EventType>)
+        {
+            auto& e { std::get<IndexInPack<EventType, EventTs...>>(mDispatchingEvents.events)[entry.eventIndex] };
+
+            //already checked for duplicates when it was enqueued
+            if(entry.correlationID == INVALID_CORRELATION_ID)
+                publish(e, subscribersOf<EventType>());
+            else
+                completeRequest(entry.correlationID, IndexInPack<EventType, EventTs...>, e);
+        }
+    }
+
+    CorrelationID allocateRequest(std::size_t responseTypeIndex, OnEventCallback onReply,
+        std::function<void()> onExpired, std::chrono::steady_clock::time_point expiry)
+    {
+        if(!mPendingRequests)
+            mPendingRequests = std::make_unique<PendingRequests>();
+
+        auto& pending { *mPendingRequests };
+        if(pending.freeCount == 0)
+            return INVALID_CORRELATION_ID;
+
+        auto const slotIndex { pending.freeSlots[--pending.freeCount] };
+        auto& slot { pending.slots[slotIndex] };
+        slot.onReply = std::move(onReply);
+        slot.onExpired = std::move(onExpired);
+        slot.expiry = expiry;
+        slot.responseTypeIndex = responseTypeIndex;
+        slot.inUse = true;
+
+        return (CorrelationID{slot.generation} << 16) | (slotIndex + 1u);
+    }
+
+    void completeRequest(CorrelationID correlationID, std::size_t responseTypeIndex, Event const& resp)
+    {
+        if(!mPendingRequests)
+            return;
+
+        auto const slotIndex { static_cast<std::size_t>(correlationID & 0xFFFF) - 1 };
+        if(slotIndex >= MAX_PENDING_REQUESTS)
+            return;
+
+        auto& slot { mPendingRequests->slots[slotIndex] };
+
+        //drop replies to requests that already expired, and replies of the wrong type
+        if(!slot.inUse || slot.generation != (correlationID >> 16) || slot.responseTypeIndex != responseTypeIndex)
+            return;
+
+        auto onReply { std::move(slot.onReply) };
+        mPendingRequests->release(slotIndex);
+        onReply(resp);
+    }
+
+    void expireRequests(std::chrono::steady_clock::time_point now)
+    {
+        if(!mPendingRequests || mPendingRequests->freeCount == MAX_PENDING_REQUESTS)
+            return;
+
+        for(std::size_t i{0}; i < MAX_PENDING_REQUESTS; ++i)
+        {
+            auto& slot { mPendingRequests->slots[i] };
+            if(slot.inUse && slot.expiry <= now)
+            {
+                auto onExpired { std::move(slot.onExpired) };
+                mPendingRequests->release(i);
+
+                if(onExpired)
+                    onExpired();
+            }
+        }
+    }
+
+    template <typename EventType>
+    SubscriberList& subscribersOf() 
+    {
+        return mSubscriberLists[StorageIndexOf<EventType>];
+    }
+
+    //Returns nullptr if eventTypeIdx is not one of EventTs, or is compiled out.
+    SubscriberList* subscribersOf(std::type_index eventTypeIdx)
+    {
+        static std::array<std::type_index, sizeof...(EventTs)> const typeIndices { std::type_index{typeid(EventTs)}... };
+
+        auto const it { std::ranges::find(typeIndices, eventTypeIdx) };
+        if(it == typeIndices.end() || STORAGE_INDICES[it - typeIndices.begin()] == NOT_STORED)
+            return nullptr;
+
+        return &mSubscriberLists[STORAGE_INDICES[it - typeIndices.begin()]];
+    }
+
+    template <typename EventType>
+    void publish(EventType& e, SubscriberList& subscriberList)
+    {
+        if(subscriberList.specialCases != 0 && holdIfPaused(e))
+            return;
+
+        callPublishHook(e);
+
+        //handlers wired in at compile time (see StaticEventSystem) are plain direct calls
+        StaticHandlerList::dispatch(std::as_const(e));
+
+        if(subscriberList.subscriptions.empty())
+            return;
+
+        ++subscriberList.dispatchDepth;
+        callSubscriptions(subscriberList, e);
+        endDispatch(subscriberList);
+    }
+
+    //publish for ShardedDispatcher workers, which publish the same type on several threads at once.
+    //The list is only read, so this leaves dispatchDepth (and what waits for it to reach 0) to the owning thread.
+    template <typename EventType>
+    void publishShared(EventType& e, SubscriberList& subscriberList)
+    {
+        callPublishHook(e);
+        StaticHandlerList::dispatch(std::as_const(e));
+
+        if(subscriberList.subscriptions.empty())
+            return;
+
+        subscriberList.sharedDispatchCount.fetch_add(1, std::memory_order_relaxed);
+        callSubscriptions(subscriberList, e);
+        subscriberList.sharedDispatchCount.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    void callSubscriptions(SubscriberList& subscriberList, Event const& e)
+    {
+        //Subscriptions added by a callback during this loop wait in pendingSubscriptions so the list 
+        //doesnt change under it. They will be called starting with the next pub.
+        if(subscriberList.specialCases == 0)
+        {
+            for(auto& subscription : std::span{subscriberList.subscriptions})
+            {
+                //an unsub during dispatch leaves a tombstone
+                if(std::atomic_ref{subscription.remainingCalls}.load(std::memory_order_relaxed) != 0)
+                    subscription.callback(e);
+            }
+        }
+        else if(subscriberList.dependencies.empty())
+        {
+            for(std::size_t i{0}, count{subscriberList.subscriptions.size()}; i < count; ++i)
+                subscriberList.call(i, e);
+        }
+        else
+        {
+            auto const& order { subscriberList.graph.order };
+            for(std::size_t i{0}, count{order.size()}; i < count; ++i)
+                subscriberList.call(order[i], e);
+        }
+    }
+
+    //Returns true if e was held because EventType is paused.
+    template <typename EventType>
+    bool holdIfPaused(EventType const& e)
+    {
+        constexpr auto typeIndex { IndexInPack<EventType, EventTs...> };
+        auto& pauseState { mPauseStates[StorageIndexOf<EventType>] };
+
+        if(!pauseState.isPaused)
+            return false;
+
+        if constexpr(std::is_copy_constructible_v<EventType> && std::is_copy_assignable_v<EventType>)
+        {
+            auto& heldEvents { std::get<typeIndex>(mPausedEvents.events) };
+
+            if(pauseState.coalesce && pauseState.coalescedEventIndex != PauseState::NO_EVENT)
+            {
+                heldEvents[pauseState.coalescedEventIndex] = e;
+            }
+            else
+            {
+                pauseState.coalescedEventIndex = heldEvents.size();
+                mPausedEvents.push(e, INVALID_CORRELATION_ID);
+            }
+        }
+
+        return true;
+    }
+
+    template <typename EventType>
+    void publishHeldEvent(EventQueue& events, typename EventQueue::Entry const& entry)
+    {
+        if constexpr(!IsCompiledOutEvent<EventType>)
+            publish(std::get<IndexInPack<EventType, EventTs...>>(events.events)[entry.eventIndex], subscribersOf<EventType>());
+    }
+
+    template <typename EventType>
+    bool holdQueuedEventIfPaused(typename EventQueue::Entry const& entry)
+    {
+        if constexpr(IsCompiledOutEvent<EventType>)
+            return false;
+        else
+            return entry.correlationID == INVALID_CORRELATION_ID 
+                && holdIfPaused(std::get<IndexInPack<EventType, EventTs...>>(mDispatchingEvents.events)[entry.eventIndex]);
+    }
+
+    //Take the events of paused types out of the undispatched part of mDispatchingEvents and hold them.
+    void holdPausedQueuedEvents()
+    {
+        constexpr std::array holders { &BasicEventSystem::holdQueuedEventIfPaused<EventTs>... };
+
+        auto& order { mDispatchingEvents.order };
+        order.erase(std::remove_if(order.begin() + static_cast<std::ptrdiff_t>(mDispatchCursor), order.end(), [this, &holders](auto const& entry)
+        {
+            return (this->*holders[entry.typeIndex])(entry);
+        }), order.end());
+    }
+
+    struct Dedup
+    {
+        Dedup(std::chrono::steady_clock::duration window, std::size_t capacity, std::function<std::uint64_t(Event const&)> keyOf)
+            : table{window, capacity}, keyOf{std::move(keyOf)} {}
+
+        DedupTable table;
+        std::function<std::uint64_t(Event const&)> keyOf;
+    };
+
+    template <typename EventType>
+    bool isDuplicate(EventType const& e)
+    {
+        auto const& dedup { mDedups[StorageIndexOf<EventType>] };
+        return dedup && dedup->table.isDuplicate(dedup->keyOf(e), std::chrono::steady_clock::now());
+    }
+
+    template <typename EventType>
+    void callPublishHook(EventType const& e)
+    {
+        if(mPublishHook == nullptr)
+            return;
+
+        //the derived part of the event, which sits right after the Event base
+        auto const payload { std::as_bytes(std::span{&e, 1}).subspan(sizeof(Event)) };
+        mPublishHook(mPublishHookContext, IndexInPack<EventType, EventTs...>, payload);
+    }
+
+    template <typename EventType>
+    void callPublishHookForQueued(typename EventQueue::Entry const& entry)
+    {
+        if constexpr(!IsCompiledOutEvent<EventType>)
+        {
+            if(entry.correlationID == INVALID_CORRELATION_ID)
+                callPublishHook(std::get<IndexInPack<EventType, EventTs...>>(mDispatchingEvents.events)[entry.eventIndex]);
+        }
+    }
+
+    void endDispatch(SubscriberList& subscriberList)
+    {
+        if(--subscriberList.dispatchDepth == 0)
+        {
+            subscriberList.addPendingSubscriptions();
+
+            if(subscriberList.isGraphStale)
+                subscriberList.rebuildGraph();
+
+            subscriberList.retiredCallbacks.clear();
+        }
+    }
+
+    //One Publisher::pubParallel call. Each subscription is submitted to the pool once every subscription
+    //it depends on has been called, by whichever task finished the last of those dependencies.
+    struct ParallelDispatch
+    {
+        void run(std::uint32_t index)
+        {
+            subscriberList.call(index, e);
+
+            if(usesGraph)
+            {
+                for(auto const successor : subscriberList.graph.successors[index])
+                {
+                    if(dependenciesLeft[successor].fetch_sub(1, std::memory_order_acq_rel) == 1)
+                        pool.submit([this, successor]{ run(successor); });
+                }
+            }
+
+            subscriptionsLeft.fetch_sub(1, std::memory_order_release);
+        }
+
+        Event const& e;
+        SubscriberList& subscriberList;
+        ThreadPool& pool;
+        bool usesGraph;
+        std::unique_ptr<std::atomic<std::uint32_t>[]> dependenciesLeft;
+        std::atomic<std::size_t> subscriptionsLeft;
+    };
+
+    template <typename EventType>
+    void publishParallel(EventType& e, SubscriberList& subscriberList, ThreadPool& pool)
+    {
+        if(subscriberList.specialCases != 0 && holdIfPaused(e))
+            return;
+
+        //a cycle means there is no valid parallel schedule so fall back to calling them one at a time
+        if(subscriberList.graph.hasCycle)
+        {
+            publish<EventType>(e, subscriberList);
+            return;
+        }
+
+        callPublishHook(e);
+        StaticHandlerList::dispatch(std::as_const(e));
+
+        bool const usesGraph { !subscriberList.dependencies.empty() };
+        auto const count { usesGraph ? subscriberList.graph.order.size() : subscriberList.subscriptions.size() };
+        if(count == 0)
+            return;
+
+        ++subscriberList.dispatchDepth;
+
+        ParallelDispatch dispatch 
+        { 
+            e, subscriberList, pool, usesGraph, std::make_unique<std::atomic<std::uint32_t>[]>(count), count 
+        };
+
+        auto const dependencyCountOf = [&](std::uint32_t i){ return usesGraph ? subscriberList.graph.dependencyCounts[i] : 0u; };
+
+        for(std::uint32_t i{0}; i < count; ++i)
+            dispatch.dependenciesLeft[i].store(dependencyCountOf(i), std::memory_order_relaxed);
+
+        //Check the cached counts rather than dependenciesLeft since the tasks submitted here are already counting those down.
+        for(std::uint32_t i{0}; i < count; ++i)
+        {
+            if(dependencyCountOf(i) == 0)
+                pool.submit([&dispatch, i]{ dispatch.run(i); });
+        }
+
+        //help run the tasks instead of just blocking, which also makes this safe to call from a pool thread
+        while(dispatch.subscriptionsLeft.load(std::memory_order_acquire) > 0)
+        {
+            if(!pool.tryRunTask())
+                std::this_thread::yield();
+        }
+
+        endDispatch(subscriberList);
+    }
+
+    template <typename EventType>
+    EntitySubscriberTable& entitySubscribersOf() 
+    {
+        return mEntitySubscriberTables[StorageIndexOf<EventType>];
+    }
+
+    //The subscriptions of each event type that is not compiled out, see STORAGE_INDICES.
+    std::array<SubscriberList, STORED_TYPE_COUNT> mSubscriberLists;
+    std::array<EntitySubscriberTable, STORED_TYPE_COUNT> mEntitySubscriberTables;
+
+    //mQueuedEvents is filled by enqueue/reply from any thread. dispatchQueued swaps it with
+    //mDispatchingEvents under the lock so the events can be published without holding it.
+    std::mutex mQueueMutex;
+    EventQueue mQueuedEvents;
+    EventQueue mDispatchingEvents;
+    std::size_t mDispatchCursor {0}; //how much of mDispatchingEvents has been dispatched
+    DeadlineQueue mDeadlineEvents;
+    std::atomic<std::size_t> mDeadlineEventCount {0}; //mDeadlineEvents.heap.size(), readable without the lock
+    std::array<DeadlineCounters, STORED_TYPE_COUNT> mDeadlineCounters;
+    std::mutex mQueueNotifierMutex;
+    std::function<void()> mQueueNotifier;
+    std::atomic<bool> mHasQueueNotifier {false};
+
+    PublishHook mPublishHook {nullptr};
+    void* mPublishHookContext {nullptr};
+
+    std::array<std::unique_ptr<Dedup>, STORED_TYPE_COUNT> mDedups; //see dedup
+
+    struct PauseState
+    {
+        static constexpr std::size_t NO_EVENT { SIZE_MAX };
+
+        bool isPaused {false};
+        bool coalesce {false};
+        std::size_t coalescedEventIndex {NO_EVENT}; //where the held event that coalesce overwrites is
+    };
+
+    //see pause
+    std::array<PauseState, STORED_TYPE_COUNT> mPauseStates;
+    std::size_t mPausedTypeCount {0}; //so dispatchQueued while nothing is paused is one check
+    EventQueue mPausedEvents;
+
+    Offloading mOffloading; //see enableOffloading
+
+#ifndef _WIN32
+    std::unique_ptr<SignalQueue> mSignalQueue; //see enableSignalPublishing
+#endif
+
+    std::unique_ptr<PendingRequests> mPendingRequests;
+
+    //reused by every dispatchQueuedParallel call
+    std::vector<BatchItem> mBatchItems;
+    std::unordered_map<SubscriptionID, std::uint32_t> mBatchWaveOfSubscription;
+
+    //use getSubscriber()/getPublisher() to get access to these, allowing the 
+    //user of this event system to sub/unsub or publish events respectively.
+    Subscriber mSubscriber {*this};
+    Publisher  mPublisher  {*this};
+};
+
+template <typename... EventTs>
+using EventSystem = BasicEventSystem<StaticHandlers<>, EventTs...>;
+
+//An EventSystem for when some of the handlers are known at compile time. Handlers should be StaticHandlers<...>
+//of StaticHandler types. Publishing an event (directly or through dispatchQueued) first calls its static handlers 
+//directly, which the compiler can inline, then anything subscribed at runtime through getSubscriber().
+//
+//void stepPhysics(PhysicsTick const&);
+//using SimEventSystem = StaticEventSystem<StaticHandlers<StaticHandler<PhysicsTick, &stepPhysics>>, PhysicsTick, AudioTick>;
+template <typename Handlers, typename... EventTs>
+using StaticEventSystem = BasicEventSystem<Handlers, EventTs...>;
+
+//Publishes a high volume event type on several worker threads while keeping the events that share a
+//key (entity, account, ...) in the order they were enqueued. The key of each event picks one of the 
+//workers, and each worker publishes its own queue in FIFO order, so events with the same key are never
+//reordered or run concurrently while events with different keys run in parallel.
+//The subscriptions to EventType are called on the worker threads with Publisher::pubShared so they must be 
+//thread safe, they should not be changed while the dispatcher is running, and they should only publish with
+//pubShared or enqueue. 
+//EventSys should be the EventSystem that publisher belongs to.
+//Each worker sizes its batches with an AdaptiveBatchSizer made from batching, see batchingMetrics.
+template <typename EventType, typename EventSys>
+class ShardedDispatcher
+{
+public:
+    //Returns the key that decides which worker an event goes to, for example an entity ID.
+    using KeyExtractor = std::function<std::size_t(EventType const&)>;
+
+    ShardedDispatcher(typename EventSys::Publisher const& publisher, std::size_t workerCount, KeyExtractor keyOf, BatchingOptions batching = {})
+        : mPublisher{publisher}, mKeyOf{std::move(keyOf)}
+    {
+        assert(workerCount > 0);
+
+        for(std::size_t i{0}; i < workerCount; ++i)
+            mShards.push_back(std::make_unique<Shard>(batching));
+
+        for(auto& shard : mShards)
+            shard->worker = std::jthread{[this, &shard = *shard]{ runWorker(shard); }};
+    }
+
+    //Everything that was enqueued is still published before the workers are joined.
+    ~ShardedDispatcher()
+    {
+        for(auto& shard : mShards)
+        {
+            {
+                std::scoped_lock lock {shard->mutex};
+                shard->isStopping = true;
+            }
+
+            shard->wakeUp.notify_one();
+        }
+    }
+
+    ShardedDispatcher(ShardedDispatcher const&)=delete;
+    ShardedDispatcher& operator=(ShardedDispatcher const&)=delete;
+
+    //Thread safe. Queue e on the worker that its key maps to.
+    void enqueue(EventType e)
+    {
+        //spread the bits of keys that are close together (sequential IDs) before picking a worker
+        auto const hash { static_cast<std::uint64_t>(mKeyOf(e)) * 0x9E3779B97F4A7C15ull };
+        auto& shard { *mShards[(hash >> 32) % mShards.size()] };
+
+        {
+            std::scoped_lock lock {shard.mutex};
+            shard.queue.push_back(std::move(e));
+            ++shard.enqueuedCount;
+        }
+
+        shard.wakeUp.notify_one();
+    }
+
+    //Block until every event enqueued before this call has been published.
+    void flush()
+    {
+        for(auto& shard : mShards)
+        {
+            std::unique_lock lock {shard->mutex};
+            auto const target { shard->enqueuedCount };
+            shard->idle.wait(lock, [&]{ return shard->publishedCount >= target; });
+        }
+    }
+
+    std::size_t workerCount() const {return mShards.size();}
+
+    //The batch sizes worker workerIndex has been choosing, and what it chose them from.
+    AdaptiveBatchSizer::Metrics batchingMetrics(std::size_t workerIndex) const
+    {
+        return mShards[workerIndex]->batchSizer.metrics();
+    }
+
+private:
+    struct Shard
+    {
+        explicit Shard(BatchingOptions batching) : batchSizer{batching} {}
+
+        std::mutex mutex;
+        std::condition_variable wakeUp;
+        std::condition_variable idle;
+        std::deque<EventType> queue;
+        std::vector<EventType> publishing; //only touched by the worker
+        std::uint64_t enqueuedCount {0};
+        std::uint64_t publishedCount {0};
+        bool isStopping {false};
+        AdaptiveBatchSizer batchSizer; //only touched by the worker
+        std::jthread worker;
+    };
+
+    void runWorker(Shard& shard)
+    {
+        std::unique_lock lock {shard.mutex};
+
+        for(;;)
+        {
+            shard.wakeUp.wait(lock, [&shard]{ return !shard.queue.empty() || shard.isStopping; });
+
+            if(shard.queue.empty())
+                return;
+
+            if(!shard.isStopping)
+            {
+                auto const linger { shard.batchSizer.lingerFor(shard.queue.size()) };
+
+                if(linger.duration.count() > 0)
+                    shard.wakeUp.wait_for(lock, linger.duration, [&]{ return shard.queue.size() >= linger.untilBacklog || shard.isStopping; });
+            }
+
+            auto const batchSize { shard.batchSizer.take(shard.queue.size()) };
+            auto const batchEnd { shard.queue.begin() + static_cast<std::ptrdiff_t>(batchSize) };
+
+            shard.publishing.assign(std::make_move_iterator(shard.queue.begin()), std::make_move_iterator(batchEnd));
+            shard.queue.erase(shard.queue.begin(), batchEnd);
+            lock.unlock();
+
+            auto const startTime { std::chrono::steady_clock::now() };
+
+            for(auto& e : shard.publishing)
+                mPublisher.pubShared(e);
+
+            shard.batchSizer.recordDispatchTime(batchSize, std::chrono::steady_clock::now() - startTime);
+            shard.publishing.clear();
+
+            lock.lock();
+            shard.publishedCount += batchSize;
+            shard.idle.notify_all();
+        }
+    }
+
+    typename EventSys::Publisher const& mPublisher;
+    KeyExtractor mKeyOf;
+    std::vector<std::unique_ptr<Shard>> mShards;
+};
+
+//Drains the queues of several EventSystems on one thread without letting a busy one starve the quiet ones.
+//It uses deficit round robin: every round each queue earns its quantum of events, dispatches up to
+//what it has earned, and keeps whatever it did not use only while it still has events waiting.
+//A queue with twice the quantum of another gets twice the share of the thread when both are busy,
+//and no queue ever waits for more than one round of the other queues' quanta.
+//Destroy it before the EventSystems that were added to it, its destructor stops the thread and removes
+//the queue notifier it set on each of them.
+class MultiQueueDispatcher
+{
+public:
+    using QueueID = std::size_t;
+
+    struct QueueMetrics
+    {
+        std::uint64_t dispatchedCount; //total events dispatched
+        std::uint64_t roundsServed;    //rounds in which this queue had events waiting
+        std::size_t lastBacklog;       //events waiting at the start of its last turn
+        std::size_t maxBacklog;
+        std::size_t quantum;
+    };
+
+    MultiQueueDispatcher()=default;
+    ~MultiQueueDispatcher()
+    {
+        stop();
+
+        for(auto& queue : mQueues)
+            queue->removeNotifier();
+    }
+
+    MultiQueueDispatcher(MultiQueueDispatcher const&)=delete;
+    MultiQueueDispatcher& operator=(MultiQueueDispatcher const&)=delete;
+
+    //Add eventSys (any EventSystem) before calling start. From then on its queue must only be dispatched by this.
+    //quantum is how many events it can dispatch per round, which doubles as its weight.
+    template <typename EventSys>
+    QueueID add(EventSys& eventSys, std::size_t quantum = 64)
+    {
+        assert(!mThread.joinable() && "add every queue before starting the MultiQueueDispatcher");
+        assert(quantum > 0);
+
+        auto& queue { *mQueues.emplace_back(std::make_unique<Queue>()) };
+        queue.dispatchUpTo = [&eventSys](std::size_t maxEvents){ return eventSys.dispatchQueued(maxEvents); };
+        queue.backlog = [&eventSys]{ return eventSys.queuedCount(); };
+        queue.removeNotifier = [&eventSys]{ eventSys.setQueueNotifier({}); };
+        queue.quantum = quantum;
+
+        eventSys.setQueueNotifier([this]{ wakeUp(); });
+
+        return mQueues.size() - 1;
+    }
+
+    //Give every queue one turn on the calling thread. Returns the number of events dispatched.
+    std::size_t runRound()
+    {
+        std::size_t dispatchedCount {0};
+
+        for(auto& queuePtr : mQueues)
+        {
+            auto& queue { *queuePtr };
+            auto const backlog { queue.backlog() };
+
+            queue.lastBacklog.store(backlog, std::memory_order_relaxed);
+            if(backlog > queue.maxBacklog.load(std::memory_order_relaxed))
+                queue.maxBacklog.store(backlog, std::memory_order_relaxed);
+
+            if(backlog == 0)
+            {
+                queue.deficit = 0;
+                queue.dispatchUpTo(0); //still lets it expire timed out requests
+                continue;
+            }
+
+            queue.deficit += queue.quantum;
+            auto const dispatched { queue.dispatchUpTo(queue.deficit) };
+            queue.deficit -= std::min(queue.deficit, dispatched);
+
+            if(dispatched >= backlog)
+                queue.deficit = 0;
+
+            queue.dispatchedCount.fetch_add(dispatched, std::memory_order_relaxed);
+            queue.roundsServed.fetch_add(1, std::memory_order_relaxed);
+            dispatchedCount += dispatched;
+        }
+
+        return dispatchedCount;
+    }
+
+    //Run rounds on a thread of its own, sleeping whenever every queue is empty.
+    void start()
+    {
+        mThread = std::jthread{[this](std::stop_token stopToken)
+        {
+            while(!stopToken.stop_requested())
+            {
+                if(runRound() > 0)
+                    continue;
+
+                std::unique_lock lock {mWakeUpMutex};
+
+                //wake up now and then even with nothing queued so requests can still expire
+                mWakeUp.wait_for(lock, std::chrono::milliseconds{10}, [&]{ return mHasWork || stopToken.stop_requested(); });
+                mHasWork = false;
+            }
+        }};
+    }
+
+    void stop()
+    {
+        if(!mThread.joinable())
+            return;
+
+        mThread.request_stop();
+        wakeUp();
+        mThread.join();
+    }
+
+    QueueMetrics metrics(QueueID queueID) const
+    {
+        auto const& queue { *mQueues[queueID] };
+        return
+        {
+            queue.dispatchedCount.load(std::memory_order_relaxed),
+            queue.roundsServed.load(std::memory_order_relaxed),
+            queue.lastBacklog.load(std::memory_order_relaxed),
+            queue.maxBacklog.load(std::memory_order_relaxed),
+            queue.quantum
+        };
+    }
+
+private:
+    struct Queue
+    {
+        std::function<std::size_t(std::size_t)> dispatchUpTo;
+        std::function<std::size_t()> backlog;
+        std::function<void()> removeNotifier;
+        std::size_t quantum {0};
+        std::size_t deficit {0};
+
+        std::atomic<std::uint64_t> dispatchedCount {0};
+        std::atomic<std::uint64_t> roundsServed {0};
+        std::atomic<std::size_t> lastBacklog {0};
+        std::atomic<std::size_t> maxBacklog {0};
+    };
+
+    void wakeUp()
+    {
+        {
+            std::scoped_lock lock {mWakeUpMutex};
+            mHasWork = true;
+        }
+
+        mWakeUp.notify_one();
+    }
+
+    std::vector<std::unique_ptr<Queue>> mQueues;
+
+    std::mutex mWakeUpMutex;
+    std::condition_variable mWakeUp;
+    bool mHasWork {false};
+
+    std::jthread mThread;
 };
\ No newline at end of file
@@ -0,0 +1,317 @@
+#pragma once
+#include <filesystem>
+#include <system_error>
+#include <span>
+#include <cstddef> //std::byte
+#include <cstdint>
+#include <utility> //std::exchange
+#include <algorithm> //std::min
+#include <cassert>
+
+#ifdef _WIN32
+    #ifndef WIN32_LEAN_AND_MEAN
+        #define WIN32_LEAN_AND_MEAN
+    #endif
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <cerrno>
+#endif
+
+//The little bit of platform file handling the persistent parts of the EventSystem (EventLog, FlightRecorder) need.
+//Everything here throws std::system_error when the operating system reports a failure.
+
+[[noreturn]] inline void throwLastFileError(char const* what)
+{
+#ifdef _WIN32
+    throw std::system_error{static_cast<int>(GetLastError()), std::system_category(), what};
+#else
+    throw std::system_error{errno, std::system_category(), what};
+#endif
+}
+
+//A file that is only ever appended to. Created if it does not exist.
+class AppendOnlyFile
+{
+public:
+    AppendOnlyFile()=default;
+
+    explicit AppendOnlyFile(std::filesystem::path const& path)
+    {
+#ifdef _WIN32
+        mHandle = CreateFileW(path.c_str(), FILE_APPEND_DATA, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if(mHandle == INVALID_HANDLE_VALUE)
+            throwLastFileError("AppendOnlyFile could not open file");
+
+        LARGE_INTEGER size {};
+        GetFileSizeEx(mHandle, &size);
+        mSize = static_cast<std::uint64_t>(size.QuadPart);
+#else
+        mHandle = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if(mHandle < 0)
+            throwLastFileError("AppendOnlyFile could not open file");
+
+        struct stat status {};
+        ::fstat(mHandle, &status);
+        mSize = static_cast<std::uint64_t>(status.st_size);
+#endif
+    }
+
+    ~AppendOnlyFile() {close();}
+
+    AppendOnlyFile(AppendOnlyFile&& other) noexcept
+        : mHandle{std::exchange(other.mHandle, INVALID_FILE)}, mSize{other.mSize} {}
+
+    AppendOnlyFile& operator=(AppendOnlyFile&& other) noexcept
+    {
+        if(this != &other)
+        {
+            close();
+            mHandle = std::exchange(other.mHandle, INVALID_FILE);
+            mSize = other.mSize;
+        }
+
+        return *this;
+    }
+
+    void append(std::span<std::byte const> bytes)
+    {
+        while(!bytes.empty())
+        {
+#ifdef _WIN32
+            DWORD written {0};
+            auto const chunk { static_cast<DWORD>(std::min<std::size_t>(bytes.size(), 1u << 30)) };
+            if(!WriteFile(mHandle, bytes.data(), chunk, &written, nullptr))
+                throwLastFileError("AppendOnlyFile::append failed");
+#else
+            auto const written { ::write(mHandle, bytes.data(), bytes.size()) };
+            if(written < 0)
+            {
+                if(errno == EINTR)
+                    continue;
+
+                throwLastFileError("AppendOnlyFile::append failed");
+            }
+#endif
+            bytes = bytes.subspan(static_cast<std::size_t>(written));
+            mSize += static_cast<std::uint64_t>(written);
+        }
+    }
+
+    //Block until everything appended so far is on disk.
+    void sync()
+    {
+#ifdef _WIN32
+        if(!FlushFileBuffers(mHandle))
+            throwLastFileError("AppendOnlyFile::sync failed");
+#elif defined(__APPLE__)
+        if(::fcntl(mHandle, F_FULLFSYNC) < 0 && ::fsync(mHandle) < 0) //plain fsync doesnt reach the disk on macOS
+            throwLastFileError("AppendOnlyFile::sync failed");
+#else
+        if(::fdatasync(mHandle) < 0)
+            throwLastFileError("AppendOnlyFile::sync failed");
+#endif
+    }
+
+    void close()
+    {
+        if(mHandle == INVALID_FILE)
+            return;
+
+#ifdef _WIN32
+        CloseHandle(mHandle);
+#else
+        ::close(mHandle);
+#endif
+        mHandle = INVALID_FILE;
+    }
+
+    bool isOpen() const {return mHandle != INVALID_FILE;}
+    std::uint64_t size() const {return mSize;}
+
+private:
+#ifdef _WIN32
+    static inline HANDLE const INVALID_FILE {INVALID_HANDLE_VALUE};
+    HANDLE mHandle {INVALID_FILE};
+#else
+    static constexpr int INVALID_FILE {-1};
+    int mHandle {INVALID_FILE};
+#endif
+    std::uint64_t mSize {0};
+};
+
+//A whole file mapped read only into memory, for reading it back at the speed of the page cache.
+class MappedFile
+{
+public:
+    MappedFile()=default;
+
+    explicit MappedFile(std::filesystem::path const& path)
+    {
+        auto const size { std::filesystem::file_size(path) };
+        if(size == 0)
+            return;
+
+#ifdef _WIN32
+        auto const file { CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr) };
+        if(file == INVALID_HANDLE_VALUE)
+            throwLastFileError("MappedFile could not open file");
+
+        auto const mapping { CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr) };
+        CloseHandle(file);
+        if(mapping == nullptr)
+            throwLastFileError("MappedFile could not map file");
+
+        auto const data { MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) };
+        CloseHandle(mapping);
+        if(data == nullptr)
+            throwLastFileError("MappedFile could not map file");
+#else
+        auto const fd { ::open(path.c_str(), O_RDONLY | O_CLOEXEC) };
+        if(fd < 0)
+            throwLastFileError("MappedFile could not open file");
+
+        auto const data { ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) };
+        ::close(fd);
+        if(data == MAP_FAILED)
+            throwLastFileError("MappedFile could not map file");
+
+        ::madvise(data, size, MADV_SEQUENTIAL);
+#endif
+        mBytes = {static_cast<std::byte const*>(data), static_cast<std::size_t>(size)};
+    }
+
+    ~MappedFile() {unmap();}
+
+    MappedFile(MappedFile&& other) noexcept : mBytes{std::exchange(other.mBytes, {})} {}
+
+    MappedFile& operator=(MappedFile&& other) noexcept
+    {
+        if(this != &other)
+        {
+            unmap();
+            mBytes = std::exchange(other.mBytes, {});
+        }
+
+        return *this;
+    }
+
+    std::span<std::byte const> bytes() const {return mBytes;}
+
+private:
+    void unmap()
+    {
+        if(mBytes.empty())
+            return;
+
+#ifdef _WIN32
+        UnmapViewOfFile(mBytes.data());
+#else
+        ::munmap(const_cast<std::byte*>(mBytes.data()), mBytes.size());
+#endif
+        mBytes = {};
+    }
+
+    std::span<std::byte const> mBytes;
+};
+
+//A file of a fixed size mapped read/write and shared with the file, so what is written to the memory ends up in 
+//the file even if the process dies right after. The file is created, or truncated and resized, to size.
+class WritableMappedFile
+{
+public:
+    WritableMappedFile()=default;
+
+    WritableMappedFile(std::filesystem::path const& path, std::size_t size)
+    {
+        assert(size > 0);
+
+#ifdef _WIN32
+        auto const file { CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr) };
+        if(file == INVALID_HANDLE_VALUE)
+            throwLastFileError("WritableMappedFile could not create file");
+
+        //making the mapping this big also grows the file to it
+        auto const mapping { CreateFileMappingW(file, nullptr, PAGE_READWRITE, static_cast<DWORD>(static_cast<std::uint64_t>(size) >> 32), static_cast<DWORD>(size), nullptr) };
+        CloseHandle(file);
+        if(mapping == nullptr)
+            throwLastFileError("WritableMappedFile could not map file");
+
+        auto const data { MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, size) };
+        CloseHandle(mapping);
+        if(data == nullptr)
+            throwLastFileError("WritableMappedFile could not map file");
+#else
+        auto const fd { ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644) };
+        if(fd < 0)
+            throwLastFileError("WritableMappedFile could not create file");
+
+        if(::ftruncate(fd, static_cast<off_t>(size)) < 0)
+        {
+            ::close(fd);
+            throwLastFileError("WritableMappedFile could not resize file");
+        }
+
+        auto const data { ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) };
+        ::close(fd);
+        if(data == MAP_FAILED)
+            throwLastFileError("WritableMappedFile could not map file");
+#endif
+        mBytes = {static_cast<std::byte*>(data), size};
+    }
+
+    ~WritableMappedFile() {unmap();}
+
+    WritableMappedFile(WritableMappedFile&& other) noexcept : mBytes{std::exchange(other.mBytes, {})} {}
+
+    WritableMappedFile& operator=(WritableMappedFile&& other) noexcept
+    {
+        if(this != &other)
+        {
+            unmap();
+            mBytes = std::exchange(other.mBytes, {});
+        }
+
+        return *this;
+    }
+
+    std::span<std::byte> bytes() const {return mBytes;}
+
+private:
+    void unmap()
+    {
+        if(mBytes.empty())
+            return;
+
+#ifdef _WIN32
+        UnmapViewOfFile(mBytes.data());
+#else
+        ::munmap(mBytes.data(), mBytes.size());
+#endif
+        mBytes = {};
+    }
+
+    std::span<std::byte> mBytes;
+};
+
+//Make files created, renamed or removed in directory survive a crash. Nothing to do on Windows.
+inline void syncDirectory([[maybe_unused]] std::filesystem::path const& directory)
+{
+#ifndef _WIN32
+    auto const fd { ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC) };
+    if(fd < 0)
+        throwLastFileError("syncDirectory could not open directory");
+
+    auto const result { ::fsync(fd) };
+    ::close(fd);
+
+    if(result < 0)
+        throwLastFileError("syncDirectory failed");
+#endif
+}
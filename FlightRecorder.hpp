@@ -0,0 +1,370 @@
+#pragma once
+#include "EventSys.hpp"
+#include "FileIO.hpp"
+#include <cstring> //std::memcpy
+#include <cstddef> //offsetof
+#include <bit> //std::bit_ceil
+
+#if defined(_M_X64) || defined(_M_IX86)
+    #include <intrin.h> //__rdtsc
+    #define FLIGHT_RECORDER_USES_TSC
+#elif defined(__x86_64__) || defined(__i386__)
+    #include <x86intrin.h> //__rdtsc
+    #define FLIGHT_RECORDER_USES_TSC
+#endif
+
+struct FlightRecorderOptions
+{
+    std::size_t threadCount {16};        //threads that can record at once, each gets a ring of its own
+    std::size_t recordsPerThread {4096}; //how many of its latest events each thread's ring keeps, rounded up to a power of 2
+    std::size_t payloadBytes {48};       //how much of each event (after its Event base) is kept
+};
+
+//One event read back from a flight recorder file with FlightRecorder::read.
+struct FlightRecord
+{
+    std::uint32_t thread;    //which ring it was in, one per publishing thread (a ring is reused once its thread exits)
+    std::uint16_t typeIndex; //the position of the event type in the EventSystem's EventTs
+    std::chrono::system_clock::time_point time;
+    std::vector<std::byte> payload; //the first payloadBytes of the event after its Event base
+};
+
+//Keeps the last few thousand events published through the EventSystems it is attached to in a memory mapped
+//file, so that after a crash the file still says what was happening. Nothing is written with system calls,
+//the operating system owns the pages and writes them out even if the process dies.
+//Every publishing thread claims its own ring in the file the first time it publishes, and only ever writes
+//to that ring, so recording takes no locks and no atomic read-modify-writes: copy a small record,
+//then bump the ring's count. The ring goes back to the recorder when the thread exits, for the next new thread.
+//Threads beyond threadCount at once are not recorded (see droppedCount).
+//Times are taken from the time stamp counter on x86, which is far cheaper than reading a clock, and each ring 
+//now and then stores which wall clock time a counter value was so read can convert them.
+//The payload is the raw bytes of the event, so members that point elsewhere (std::string, ...)
+//only record the pointer. Decode the file offline with FlightRecorder::read.
+class FlightRecorder
+{
+public:
+    FlightRecorder(std::filesystem::path const& path, FlightRecorderOptions options = {})
+        : mRecordSize{sizeof(RecordHeader) + roundUpTo(options.payloadBytes, 8)},
+          mRecordsPerRing{std::bit_ceil(options.recordsPerThread)}, mRingCount{options.threadCount},
+          mFile{path, sizeof(FileHeader) + mRingCount * ringSizeOf(mRecordsPerRing, mRecordSize)}
+    {
+        assert(options.threadCount > 0 && options.recordsPerThread > 0);
+        assert(options.payloadBytes <= UINT16_MAX);
+
+        FileHeader header {};
+        std::memcpy(header.magic, MAGIC, sizeof(header.magic));
+        header.version = VERSION;
+        header.recordSize = static_cast<std::uint32_t>(mRecordSize);
+        header.ringCount = static_cast<std::uint32_t>(mRingCount);
+        header.recordsPerRing = mRecordsPerRing;
+        header.ticksAtStart = readTicks();
+        header.systemAtStart = nanosecondsSinceEpoch(std::chrono::system_clock::now());
+
+        std::memcpy(mFile.bytes().data(), &header, sizeof(header));
+    }
+
+    //Threads that still hold rings release them into nothing once they exit.
+    ~FlightRecorder()
+    {
+        std::scoped_lock lock {mRings->mutex};
+        mRings->isClosed = true;
+    }
+
+    FlightRecorder(FlightRecorder const&)=delete;
+    FlightRecorder& operator=(FlightRecorder const&)=delete;
+
+    //Record everything published through eventSys. Detach before this recorder is destroyed.
+    template <typename EventSys>
+    void attach(EventSys& eventSys)
+    {
+        eventSys.setPublishHook(&FlightRecorder::onPublish, this);
+    }
+
+    template <typename EventSys>
+    static void detach(EventSys& eventSys)
+    {
+        eventSys.setPublishHook(nullptr, nullptr);
+    }
+
+    void record(std::uint32_t typeIndex, std::span<std::byte const> payload)
+    {
+        auto const ring { ringOfThisThread() };
+        if(ring == nullptr)
+        {
+            mDroppedCount.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        //only this thread writes the count, the atomic_ref just orders the record before it for readers
+        auto const count { std::atomic_ref{ring->writeCount}.load(std::memory_order_relaxed) };
+        auto const record { recordsOf(ring) + (count & (mRecordsPerRing - 1)) * mRecordSize };
+        auto const payloadSize { std::min(payload.size(), mRecordSize - sizeof(RecordHeader)) };
+
+        RecordHeader const header
+        {
+            readTicks(),
+            static_cast<std::uint16_t>(typeIndex),
+            static_cast<std::uint16_t>(payloadSize),
+            static_cast<std::uint32_t>(count + 1)
+        };
+
+        if((count & (CALIBRATION_INTERVAL - 1)) == 0)
+        {
+            ring->calibrationTicks = header.ticks;
+            ring->calibrationSystemTime = nanosecondsSinceEpoch(std::chrono::system_clock::now());
+        }
+
+        //the sequence last, it is what tells read the record is complete
+        std::memcpy(record + sizeof(header), payload.data(), payloadSize);
+        std::memcpy(record, &header, offsetof(RecordHeader, sequence));
+        std::atomic_ref{*reinterpret_cast<std::uint32_t*>(record + offsetof(RecordHeader, sequence))}.store(header.sequence, std::memory_order_release);
+
+        std::atomic_ref{ring->writeCount}.store(count + 1, std::memory_order_release);
+    }
+
+    //Events that were not recorded because more than threadCount threads published.
+    std::uint64_t droppedCount() const {return mDroppedCount.load(std::memory_order_relaxed);}
+
+    //Decode a file written by a FlightRecorder, from this process or one that crashed. Oldest first.
+    static std::vector<FlightRecord> read(std::filesystem::path const& path)
+    {
+        MappedFile const file {path};
+        auto const bytes { file.bytes() };
+
+        FileHeader header {};
+        if(bytes.size() < sizeof(header))
+            return {};
+
+        std::memcpy(&header, bytes.data(), sizeof(header));
+        if(std::memcmp(header.magic, MAGIC, sizeof(header.magic)) != 0 || header.version != VERSION)
+            return {};
+
+        auto const ringSize { ringSizeOf(header.recordsPerRing, header.recordSize) };
+        if(bytes.size() < sizeof(FileHeader) + header.ringCount * ringSize)
+            return {};
+
+        auto const ringAt = [&](std::uint32_t ringIndex)
+        {
+            RingHeader ring;
+            std::memcpy(&ring, bytes.data() + sizeof(FileHeader) + ringIndex * ringSize, sizeof(ring));
+            return ring;
+        };
+
+        //the calibration furthest from the start gives the most accurate rate
+        double nanosecondsPerTick {1.0};
+        std::uint64_t calibrationDistance {0};
+
+        for(std::uint32_t ringIndex{0}; ringIndex < header.ringCount; ++ringIndex)
+        {
+            auto const ring { ringAt(ringIndex) };
+
+            if(ring.calibrationTicks > header.ticksAtStart && ring.calibrationTicks - header.ticksAtStart > calibrationDistance)
+            {
+                calibrationDistance = ring.calibrationTicks - header.ticksAtStart;
+                nanosecondsPerTick = static_cast<double>(ring.calibrationSystemTime - header.systemAtStart) / static_cast<double>(calibrationDistance);
+            }
+        }
+
+        std::vector<FlightRecord> records;
+
+        for(std::uint32_t ringIndex{0}; ringIndex < header.ringCount; ++ringIndex)
+        {
+            auto const ring { bytes.data() + sizeof(FileHeader) + ringIndex * ringSize };
+            auto const count { ringAt(ringIndex).writeCount };
+            auto const first { count > header.recordsPerRing ? count - header.recordsPerRing : 0 };
+
+            //one past count too, in case the process died between writing a record and counting it
+            for(auto i { first }; i <= count; ++i)
+            {
+                auto const record { ring + sizeof(RingHeader) + (i % header.recordsPerRing) * header.recordSize };
+
+                RecordHeader recordHeader;
+                std::memcpy(&recordHeader, record, sizeof(recordHeader));
+
+                //a slot that was never written, or was overwritten after count was read
+                if(recordHeader.sequence != static_cast<std::uint32_t>(i + 1) || recordHeader.payloadSize > header.recordSize - sizeof(RecordHeader))
+                    continue;
+
+                auto const sinceStart { (static_cast<double>(recordHeader.ticks) - static_cast<double>(header.ticksAtStart)) * nanosecondsPerTick };
+                auto const time { std::chrono::system_clock::time_point{std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::nanoseconds{header.systemAtStart + static_cast<std::int64_t>(sinceStart)})} };
+                auto const payload { record + sizeof(RecordHeader) };
+
+                records.push_back({ringIndex, recordHeader.typeIndex, time, {payload, payload + recordHeader.payloadSize}});
+            }
+        }
+
+        std::ranges::stable_sort(records, {}, &FlightRecord::time);
+        return records;
+    }
+
+private:
+    static constexpr char MAGIC[8] {'E', 'V', 'F', 'L', 'I', 'G', 'H', 'T'};
+    static constexpr std::uint32_t VERSION {2};
+
+    struct alignas(64) FileHeader
+    {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t recordSize;
+        std::uint32_t ringCount;
+        std::uint32_t padding;
+        std::uint64_t recordsPerRing;
+        std::uint64_t ticksAtStart; //readTicks and system_clock nanoseconds at the same moment
+        std::int64_t systemAtStart;
+    };
+
+    //a cache line each so threads dont share one while counting
+    struct alignas(64) RingHeader
+    {
+        std::uint64_t writeCount;
+        std::uint64_t calibrationTicks; //readTicks and system_clock nanoseconds at the same moment, later than
+        std::int64_t calibrationSystemTime; //the ones in FileHeader, to work out how long a tick is
+    };
+
+    struct RecordHeader
+    {
+        std::uint64_t ticks;
+        std::uint16_t typeIndex;
+        std::uint16_t payloadSize;
+        std::uint32_t sequence; //the low bits of writeCount after this record, so stale and torn slots can be told apart
+    };
+
+    static_assert(sizeof(RecordHeader) == 16);
+
+    //records per ring between calibrations
+    static constexpr std::uint64_t CALIBRATION_INTERVAL {1 << 16};
+
+    static std::uint64_t readTicks()
+    {
+#ifdef FLIGHT_RECORDER_USES_TSC
+        return __rdtsc();
+#else
+        return static_cast<std::uint64_t>(nanosecondsSinceEpoch(std::chrono::steady_clock::now()));
+#endif
+    }
+
+    template <typename TimePoint>
+    static std::int64_t nanosecondsSinceEpoch(TimePoint time)
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+    }
+
+    static constexpr std::size_t roundUpTo(std::size_t size, std::size_t alignment) {return (size + alignment - 1) & ~(alignment - 1);}
+
+    //rings start on a cache line too
+    static constexpr std::size_t ringSizeOf(std::size_t recordsPerRing, std::size_t recordSize)
+    {
+        return roundUpTo(sizeof(RingHeader) + recordsPerRing * recordSize, 64);
+    }
+
+    static void onPublish(void* context, std::uint32_t typeIndex, std::span<std::byte const> payload)
+    {
+        static_cast<FlightRecorder*>(context)->record(typeIndex, payload);
+    }
+
+    RingHeader* ringAt(std::size_t ringIndex) const
+    {
+        return reinterpret_cast<RingHeader*>(mFile.bytes().data() + sizeof(FileHeader) + ringIndex * ringSizeOf(mRecordsPerRing, mRecordSize));
+    }
+
+    std::byte* recordsOf(RingHeader* ring) const
+    {
+        return reinterpret_cast<std::byte*>(ring) + sizeof(RingHeader);
+    }
+
+    //Which rings are free, shared with the threads that hold one so they can give it back after the recorder is gone.
+    struct RingPool
+    {
+        std::mutex mutex;
+        std::vector<std::size_t> freeRings; //released by exited threads
+        std::size_t nextRing {0}; //rings from here on were never claimed
+        bool isClosed {false}; //the recorder was destroyed
+    };
+
+    //The rings this thread holds, one per recorder it has recorded into, given back when the thread exits.
+    struct ThreadRings
+    {
+        struct Entry
+        {
+            std::uint64_t recorderID;
+            RingHeader* ring;
+            std::size_t ringIndex;
+            std::shared_ptr<RingPool> pool;
+        };
+
+        ~ThreadRings()
+        {
+            for(auto& entry : entries)
+                release(entry);
+        }
+
+        static void release(Entry& entry)
+        {
+            if(entry.ring == nullptr)
+                return;
+
+            std::scoped_lock lock {entry.pool->mutex};
+            if(!entry.pool->isClosed)
+                entry.pool->freeRings.push_back(entry.ringIndex);
+        }
+
+        std::vector<Entry> entries;
+    };
+
+    //The ring this thread claimed from this recorder, claiming one the first time. nullptr when they have run out.
+    RingHeader* ringOfThisThread()
+    {
+        thread_local ThreadRings threadRings;
+
+        //usually only one recorder, so the first entry
+        for(auto const& entry : threadRings.entries)
+        {
+            if(entry.recorderID == mID)
+                return entry.ring;
+        }
+
+        return claimRing(threadRings);
+    }
+
+    RingHeader* claimRing(ThreadRings& threadRings)
+    {
+        //forget the recorders that were destroyed while this thread held one of their rings
+        std::erase_if(threadRings.entries, [](auto const& entry)
+        {
+            std::scoped_lock lock {entry.pool->mutex};
+            return entry.pool->isClosed;
+        });
+
+        auto& entry { threadRings.entries.emplace_back(mID, nullptr, 0, mRings) };
+
+        std::scoped_lock lock {mRings->mutex};
+
+        if(!mRings->freeRings.empty())
+        {
+            entry.ringIndex = mRings->freeRings.back();
+            mRings->freeRings.pop_back();
+        }
+        else if(mRings->nextRing < mRingCount)
+        {
+            entry.ringIndex = mRings->nextRing++;
+        }
+        else
+        {
+            return nullptr; //cached as nullptr too, so a thread that was refused does not keep asking
+        }
+
+        entry.ring = ringAt(entry.ringIndex);
+        return entry.ring;
+    }
+
+    static inline std::atomic<std::uint64_t> sNextID {1};
+
+    std::uint64_t const mID {sNextID.fetch_add(1, std::memory_order_relaxed)};
+    std::size_t mRecordSize;
+    std::size_t mRecordsPerRing;
+    std::size_t mRingCount;
+    WritableMappedFile mFile;
+
+    std::shared_ptr<RingPool> mRings {std::make_shared<RingPool>()};
+    std::atomic<std::uint64_t> mDroppedCount {0};
+};
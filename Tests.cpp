@@ -0,0 +1,1608 @@
+//Behavior checks for the EventSystem. This is a separate program from main.cpp that exits with 0 when every
+//check passes. Run it under the sanitizers too, most of what it checks is lifetime and threading, for example:
+//g++ -std=c++20 -g -fsanitize=address,undefined Tests.cpp -o Tests -pthread && ./Tests
+//g++ -std=c++20 -g -fsanitize=thread Tests.cpp -o Tests -pthread && ./Tests
+//g++ -std=c++20 -g -D_GLIBCXX_DEBUG Tests.cpp -o Tests -pthread && ./Tests
+//and once with -DNDEBUG, for the checks of what release builds do where debug builds assert.
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "EventSys.hpp"
+#include "EventLog.hpp"
+#include "FlightRecorder.hpp"
+
+static int gFailureCount {0};
+
+#define CHECK(condition) \
+    do \
+    { \
+        if(!(condition)) \
+        { \
+            std::cerr << __FILE__ << ':' << __LINE__ << ": CHECK(" #condition ") failed\n"; \
+            ++gFailureCount; \
+        } \
+    } while(false)
+
+struct Ping : Event
+{
+    Ping(int value_ = 0) : value{value_} {}
+    int value;
+};
+
+struct Pong : Event {};
+
+struct CompiledOut : Event {};
+template <> struct CompileOutEvent<CompiledOut> : std::true_type {};
+
+using TestEventSystem = EventSystem<Ping, Pong>;
+
+template <> struct EventSerializer<Ping>
+{
+    static void write(Ping const& e, std::vector<std::byte>& out) { appendBytes(out, e.value); }
+    static Ping read(std::span<std::byte const> bytes) { return Ping{readBytes<int>(bytes)}; }
+};
+
+using TestEventLog = EventLog<TestEventSystem, Ping>;
+
+struct Question : RequestEvent
+{
+    Question(int value_ = 0) : value{value_} {}
+    int value;
+};
+
+struct Answer : Event
+{
+    Answer(int value_ = 0) : value{value_} {}
+    int value;
+};
+
+using RequestEventSystem = EventSystem<Question, Answer>;
+
+inline constexpr EventCategoryMask INPUT_EVENTS {1 << 0};
+inline constexpr EventCategoryMask NETWORK_EVENTS {1 << 1};
+
+struct KeyPressed : Event { static constexpr EventCategoryMask category {INPUT_EVENTS}; };
+struct MouseMoved : Event { static constexpr EventCategoryMask category {INPUT_EVENTS}; };
+struct PacketReceived : Event { static constexpr EventCategoryMask category {NETWORK_EVENTS}; };
+
+using CategoryEventSystem = EventSystem<KeyPressed, Ping, MouseMoved, PacketReceived>;
+
+//A callback that subscribes to its own event type while it is running must not move itself (or the other
+//callbacks) out from under the dispatch loop, however much the list grows.
+void subscribingFromACallback()
+{
+    TestEventSystem eventSys;
+    auto& subscriber { eventSys.getSubscriber() };
+    auto const& publisher { eventSys.getPublisher() };
+
+    int outerCallCount {0};
+    int innerCallCount {0};
+    std::string const capturedState(64, 'x'); //so the callback has state that a move would leave behind
+
+    auto outer { subscriber.sub<Ping>([&, capturedState](Event const&)
+    {
+        ++outerCallCount;
+
+        for(int i{0}; i < 50; ++i)
+            (void)subscriber.sub<Ping>([&](Event const&){ ++innerCallCount; });
+
+        CHECK(capturedState.size() == 64);
+    }) };
+
+    Ping ping;
+    publisher.pub(ping);
+
+    //subscriptions made during a pub are only called from the next one on
+    CHECK(outerCallCount == 1);
+    CHECK(innerCallCount == 0);
+
+    publisher.pub(ping);
+    CHECK(outerCallCount == 2);
+    CHECK(innerCallCount == 50);
+
+    subscriber.unsub<Ping>(outer);
+}
+
+//Unsubscribing a subscription that was made earlier in the same dispatch.
+void unsubscribingAPendingSubscription()
+{
+    TestEventSystem eventSys;
+    auto& subscriber { eventSys.getSubscriber() };
+    auto const& publisher { eventSys.getPublisher() };
+
+    int lateCallCount {0};
+
+    auto outer { subscriber.subOnce<Ping>([&](Event const&)
+    {
+        auto late { subscriber.sub<Ping>([&](Event const&){ ++lateCallCount; }) };
+        CHECK(subscriber.unsub<Ping>(late));
+        CHECK(late == INVALID_SUBSCRIPTION_ID);
+    }) };
+
+    Ping ping;
+    publisher.pub(ping);
+    publisher.pub(ping);
+
+    CHECK(lateCallCount == 0);
+    CHECK(outer != INVALID_SUBSCRIPTION_ID);
+}
+
+//Same as subscribingFromACallback but for the subscriptions of a single entity.
+void subscribingToAnEntityFromACallback()
+{
+    TestEventSystem eventSys;
+    auto& subscriber { eventSys.getSubscriber() };
+    auto const& publisher { eventSys.getPublisher() };
+
+    EntityID const entity {7};
+    struct { int outer; int inner; } callCounts {0, 0};
+
+    //only two pointers are captured so the std::function keeps them inline, a move of the callback leaves them behind
+    auto outer { subscriber.subTo<Ping>(entity, [sub = &subscriber, counts = &callCounts](Event const&)
+    {
+        for(int i{0}; i < 50; ++i)
+            (void)sub->subTo<Ping>(entity, [counts](Event const&){ ++counts->inner; });
+
+        ++counts->outer;
+    }) };
+
+    Ping ping;
+    publisher.pubTo(entity, ping);
+    CHECK(callCounts.outer == 1);
+    CHECK(callCounts.inner == 0);
+
+    publisher.pubTo(entity, ping);
+    CHECK(callCounts.outer == 2);
+    CHECK(callCounts.inner == 50);
+
+    CHECK(subscriber.unsubTo<Ping>(entity, outer));
+}
+
+//A callback that unsubscribes itself and a subscription after it in the same list. The one after it is not
+//called from then on, not even later in the same pub.
+void unsubscribingFromACallback()
+{
+    TestEventSystem eventSys;
+    auto& subscriber { eventSys.getSubscriber() };
+    auto const& publisher { eventSys.getPublisher() };
+
+    int firstCallCount {0};
+    int laterCallCount {0};
+    SubscriptionID later {INVALID_SUBSCRIPTION_ID};
+
+    SubscriptionID first {INVALID_SUBSCRIPTION_ID};
+    first = subscriber.sub<Ping>([&](Event const&)
+    {
+        ++firstCallCount;
+        CHECK(subscriber.unsub<Ping>(first));
+        CHECK(subscriber.unsub<Ping>(later));
+    });
+
+    later = subscriber.sub<Ping>([&](Event const&){ ++laterCallCount; });
+
+    Ping ping;
+    publisher.pub(ping);
+    publisher.pub(ping);
+
+    CHECK(firstCallCount == 1);
+    CHECK(laterCallCount == 0);
+    CHECK(first == INVALID_SUBSCRIPTION_ID);
+    CHECK(later == INVALID_SUBSCRIPTION_ID);
+}
+
+//A callback that replaces itself keeps running to the end with its own state, the new one is called from the next pub.
+void replacingFromACallback()
+{
+    TestEventSystem eventSys;
+    auto& subscriber { eventSys.getSubscriber() };
+    auto const& publisher { eventSys.getPublisher() };
+
+    struct { int old; int replacement; } callCounts {0, 0};
+    SubscriptionID ID {INVALID_SUBSCRIPTION_ID};
+
+    //small enough that std::function keeps it inline, so it would be gone if replace destroyed it right away
+    ID = subscriber.sub<Ping>([sub = &subscriber, counts = &callCounts, ID = &ID](Event const&)
+    {
+        CHECK(sub->replace<Ping>(*ID, [counts](Event const&){ ++counts->replacement; }));
+        ++counts->old;
+    });
+
+    Ping ping;
+    publisher.pub(ping);
+    CHECK(callCounts.old == 1);
+    CHECK(callCounts.replacement == 0);
+
+    publisher.pub(ping);
+    CHECK(callCounts.old == 1);
+    CHECK(callCounts.replacement == 1);
+
+    CHECK(subscriber.unsub<Ping>(ID));
+}
+
+//Replacing a plain subscription that is not being dispatched, from outside any callback.
+void replacingOutsideACallback()
+{
+    TestEventSystem eventSys;
+    auto& subscriber { eventSys.getSubscriber() };
+    auto const& publisher { eventSys.getPublisher() };
+
+    int oldCallCount {0};
+    int newCallCount {0};
+
+    auto before { subscriber.sub<Ping>([](Event const&){}) };
+    auto ID { subscriber.sub<Ping>([&](Event const&){ ++oldCallCount; }) };
+    auto after { subscriber.sub<Ping>([](Event const&){}) };
+
+    Ping ping;
+    publisher.pub(ping);
+
+    CHECK(subscriber.replace<Ping>(ID, [&](Event const&){ ++newCallCount; }));
+    CHECK(!subscriber.replace<Ping>(INVALID_SUBSCRIPTION_ID, [](Event const&){}));
+
+    publisher.pub(ping);
+    publisher.pub(ping);
+    CHECK(oldCallCount == 1);
+    CHECK(newCallCount == 2);
+
+    CHECK(subscriber.unsub<Ping>(ID));
+    CHECK(!subscriber.replace<Ping>(ID, [](Event const&){}));
+    CHECK(subscriber.unsub<Ping>(before));
+    CHECK(subscriber.unsub<Ping>(after));
+}
+
+//A callback that publishes its own type again. Subscriptions made by the inner pub wait for the outer one to finish.
+void publishingFromACallback()
+{
+    TestEventSystem eventSys;
+    auto& subscriber { eventSys.getSubscriber() };
+    auto const& publisher { eventSys.getPublisher() };
+
+    std::vector<int> seenValues;
+    int lateCallCount {0};
+
+    auto ID { subscriber.sub<Ping>([&](Event const& e)
+    {
+        auto const value { e.unpack<Ping>().value };
+        seenValues.push_back(value);
+
+        if(value == 0)
+        {
+            Ping inner {1};
+            publisher.pub(inner);
+        }
+        else
+        {
+            (void)subscriber.subOnce<Ping>([&](Event const&){ ++lateCallCount; });
+        }
+    }) };
+
+    Ping ping {0};
+    publisher.pub(ping);
+    CHECK((seenValues == std::vector{0, 1}));
+    CHECK(lateCallCount == 0);
+
+    Ping last {2};
+    publisher.pub(last);
+    CHECK(lateCallCount == 1);
+
+    CHECK(subscriber.unsub<Ping>(ID));
+}
+
+//ShardedDispatcher workers publish the same list on several threads at once. Events with the same key stay in
+//order, and a subN subscription is still called exactly N times.
+void publishingFromShards()
+{
+    constexpr std::size_t keyCount {8};
+    constexpr int eventsPerKey {200};
+
+    TestEventSystem eventSys;
+    auto& subscriber { eventSys.getSubscriber() };
+
+    std::mutex mutex;
+    std::vector<int> lastValueOfKey(keyCount, -1);
+    bool isInOrder {true};
+    std::atomic<int> limitedCallCount {0};
+
+    auto ID { subscriber.sub<Ping>([&](Event const& e)
+    {
+        auto const value { e.unpack<Ping>().value };
+        auto const key { static_cast<std::size_t>(value) % keyCount };
+
+        std::scoped_lock lock {mutex};
+        isInOrder = isInOrder && value > lastValueOfKey[key];
+        lastValueOfKey[key] = value;
+    }) };
+
+    (void)subscriber.subN<Ping>([&](Event const&){ ++limitedCallCount; }, 5);
+
+    {
+        ShardedDispatcher<Ping, TestEventSystem> dispatcher
+        {
+            eventSys.getPublisher(), 4, [](Ping const& ping){ return static_cast<std::size_t>(ping.value) % keyCount; }
+        };
+
+        for(int i{0}; i < eventsPerKey * static_cast<int>(keyCount); ++i)
+            dispatcher.enqueue(Ping{i});
+
+        dispatcher.flush();
+    }
+
+    CHECK(isInOrder);
+    CHECK(limitedCallCount == 5);
+    CHECK(subscriber.unsub<Ping>(ID));
+}
+
+//pubParallel runs subscriptions on the pool but keeps their SubscriptionOptions::after order.
+void publishingInParallel()
+{
+    TestEventSystem eventSys;
+    auto& subscriber { eventSys.getSubscriber() };
+    auto const& publisher { eventSys.getPublisher() };
+    ThreadPool pool {4};
+
+    std::mutex mutex;
+    std::string order;
+    auto const record = [&](char name)
+    {
+        return [&, name](Event const&)
+        {
+            std::scoped_lock lock {mutex};
+            order += name;
+        };
+    };
+
+    auto a { subscriber.sub<Ping>(record('a')) };
+    auto b { subscriber.sub<Ping>(record('b')) };
+    auto c { subscriber.sub<Ping>(record('c'), {.after = {a, b}}) };
+
+    Ping ping;
+    for(int i{0}; i < 50; ++i)
+    {
+        order.clear();
+        publisher.pubParallel(ping, pool);
+
+        CHECK(order.size() == 3);
+        CHECK(order.back() == 'c');
+    }
+
+    CHECK(subscriber.unsub<Ping>(c));
+    CHECK(subscriber.unsub<Ping>(b));
+    CHECK(subscriber.unsub<Ping>(a));
+}
+
+#ifndef _WIN32
+//pubFromSignal from several threads at once while the owning thread dispatches them. None are lost or repeated.
+void publishingFromSignals()
+{
+    constexpr int producerCount {3};
+    constexpr int eventsPerProducer {2000};
+
+    TestEventSystem eventSys;
+    int total {0};
+    auto ID { eventSys.getSubscriber().sub<Ping>([&](Event const& e){ total += e.unpack<Ping>().value; }) };
+
+    (void)eventSys.enableSignalPublishing();
+
+    std::vector<std::jthread> producers;
+    for(int i{0}; i < producerCount; ++i)
+    {
+        producers.emplace_back([&]
+        {
+            for(int j{0}; j < eventsPerProducer; ++j)
+            {
+                //the queue is small, wait for the dispatching thread to make room
+                while(!eventSys.getPublisher().pubFromSignal<Ping>(1))
+                    std::this_thread::yield();
+            }
+        });
+    }
+
+    while(total < producerCount * eventsPerProducer)
+    {
+        if(eventSys.dispatchSignalEvents() == 0)
+            std::this_thread::yield();
+    }
+
+    producers.clear();
+    CHECK(eventSys.dispatchSignalEvents() == 0);
+    CHECK(total == producerCount * eventsPerProducer);
+    CHECK(eventSys.getSubscriber().unsub<Ping>(ID));
+}
+#endif
+
+//Mailboxes on a pool and on a worker thread of their own get every event in order, and can be unsubscribed
+//while they still have events waiting.
+void deliveringToMailboxes()
+{
+    constexpr int eventCount {500};
+
+    TestEventSystem eventSys;
+    auto& subscriber { eventSys.getSubscriber() };
+    auto const& publisher { eventSys.getPublisher() };
+    ThreadPool pool {2};
+
+    struct Received
+    {
+        std::atomic<int> count {0};
+        std::atomic<bool> isInOrder {true};
+        int last {-1}; //only touched by the one mailbox it belongs to, which never runs on two threads at once
+    };
+
+    Received onPool, onWorker;
+    auto const receiveInto = [](Received& received)
+    {
+        return [&received](Event const& e)
+        {
+            auto const value { e.unpack<Ping>().value };
+            if(value != received.last + 1)
+                received.isInOrder = false;
+
+            received.last = value;
+            ++received.count;
+        };
+    };
+
+    auto pooled { subscriber.sub<Ping>(receiveInto(onPool), {.mailboxCapacity = eventCount, .mailboxPool = &pool}) };
+    auto worker { subscriber.sub<Ping>(receiveInto(onWorker), {.mailboxCapacity = 16, .mailboxOverflow = MailboxOverflowPolicy::block}) };
+    auto abandoned { subscriber.sub<Ping>([](Event const&){ std::this_thread::sleep_for(std::chrono::microseconds{50}); }, {.mailboxCapacity = eventCount}) };
+
+    for(int i{0}; i < eventCount; ++i)
+    {
+        Ping ping {i};
+        publisher.pub(ping);
+    }
+
+    CHECK(subscriber.unsub<Ping>(abandoned));
+
+    auto const deadline { std::chrono::steady_clock::now() + std::chrono::seconds{30} };
+    while((onPool.count < eventCount || onWorker.count < eventCount) && std::chrono::steady_clock::now() < deadline)
+        std::this_thread::sleep_for(std::chrono::milliseconds{1});
+
+    CHECK(onPool.count == eventCount);
+    CHECK(onWorker.count == eventCount);
+    CHECK(onPool.isInOrder);
+    CHECK(onWorker.isInOrder);
+
+    CHECK(subscriber.unsub<Ping>(pooled));
+    CHECK(subscriber.unsub<Ping>(worker));
+}
+
+//Spin until condition holds, for work that finishes on another thread. False if it didnt within 30 seconds.
+template <typename Condition>
+bool waitUntil(Condition const& condition)
+{
+    auto const deadline { std::chrono::steady_clock::now() + std::chrono::seconds{30} };
+    while(!condition() && std::chrono::steady_clock::now() < deadline)
+        std::this_thread::sleep_for(std::chrono::milliseconds{1});
+
+    return condition();
+}
+
+//Only subscriptions that allow it and take longer than the threshold move to the pool, the rest stay inline.
+void offloadingExpensiveSubscriptions()
+{
+    TestEventSystem eventSys;
+    ThreadPool pool {2};
+    eventSys.enableOffloading(pool, std::chrono::milliseconds{1});
+
+    auto& subscriber { eventSys.getSubscriber() };
+    auto const& publisher { eventSys.getPublisher() };
+    auto const publishingThread { std::this_thread::get_id() };
+
+    std::atomic<int> expensiveCallCount {0};
+    std::atomic<int> expensiveOnPoolCount {0};
+    auto expensive { subscriber.sub<Ping>([&](Event const&)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds{2});
+        if(std::this_thread::get_id() != publishingThread)
+            ++expensiveOnPoolCount;
+
+        ++expensiveCallCount;
+    }, {.allowOffload = true}) };
+
+    int cheapInlineCount {0};
+    auto cheap { subscriber.sub<Ping>([&](Event const&)
+    {
+        if(std::this_thread::get_id() == publishingThread)
+            ++cheapInlineCount;
+    }, {.allowOffload = true}) };
+
+    Ping ping;
+    for(int i{0}; i < 5; ++i)
+        publisher.pub(ping);
+
+    CHECK(waitUntil([&]{ return expensiveCallCount == 5; }));
+
+    //the first call is timed inline, the others go to the pool
+    auto const expensiveMetrics { eventSys.offloadMetrics<Ping>(expensive) };
+    CHECK(expensiveMetrics.isOffloaded);
+    CHECK(expensiveMetrics.offloadedCallCount == 4);
+    CHECK(expensiveMetrics.averageNanoseconds > 1'000'000.0);
+    CHECK(expensiveOnPoolCount == 4);
+
+    auto const cheapMetrics { eventSys.offloadMetrics<Ping>(cheap) };
+    CHECK(!cheapMetrics.isOffloaded);
+    CHECK(cheapMetrics.offloadedCallCount == 0);
+    CHECK(cheapInlineCount == 5);
+
+    CHECK(subscriber.unsub<Ping>(expensive));
+    CHECK(subscriber.unsub<Ping>(cheap));
+    CHECK(eventSys.offloadMetrics<Ping>(expensive).offloadedCallCount == 0);
+}
+
+//Offloaded calls that are still running when their subscription is removed finish with the callback they started with.
+void unsubscribingWhileOffloadedCallsRun()
+{
+    TestEventSystem eventSys;
+    ThreadPool pool {2};
+    eventSys.enableOffloading(pool, std::chrono::nanoseconds{1});
+
+    auto& subscriber { eventSys.getSubscriber() };
+    auto const& publisher { eventSys.getPublisher() };
+
+    std::atomic<int> callCount {0};
+    std::atomic<int> runningCount {0};
+    std::atomic<int> finishedCount {0};
+    std::atomic<bool> isReleased {false};
+
+    //small captures so the callback lives inside the std::function, where a use after free shows up under ASan
+    auto ID { subscriber.sub<Ping>([&](Event const&)
+    {
+        if(callCount++ == 0)
+            return;
+
+        ++runningCount;
+        while(!isReleased)
+            std::this_thread::sleep_for(std::chrono::microseconds{100});
+
+        ++finishedCount;
+    }, {.allowOffload = true}) };
+
+    Ping ping;
+    for(int i{0}; i < 3; ++i)
+        publisher.pub(ping);
+
+    CHECK(waitUntil([&]{ return runningCount == 2; }));
+    CHECK(subscriber.unsub<Ping>(ID));
+
+    publisher.pub(ping);
+    isReleased = true;
+
+    CHECK(waitUntil([&]{ return finishedCount == 2; }));
+    CHECK(callCount == 3);
+}
+
+//Subscriptions that write the same resource are never in the same wave, ones that dont conflict share one.
+void dispatchingInWaves()
+{
+    constexpr int eventCount {10};
+    constexpr ResourceSet SHARED_RESOURCE {1 << 0};
+
+    TestEventSystem eventSys;
+    auto& subscriber { eventSys.getSubscriber() };
+    auto const& publisher { eventSys.getPublisher() };
+    ThreadPool pool {4};
+
+    std::atomic<int> writersInFlight {0};
+    std::atomic<int> maxWritersInFlight {0};
+    std::atomic<int> writerCallCount {0};
+    auto const writer = [&](Event const&)
+    {
+        auto const inFlight { ++writersInFlight };
+        int max { maxWritersInFlight };
+        while(inFlight > max && !maxWritersInFlight.compare_exchange_weak(max, inFlight)) {}
+
+        std::this_thread::sleep_for(std::chrono::microseconds{200});
+        --writersInFlight;
+        ++writerCallCount;
+    };
+
+    //the first calls of these two only return once both are running, which they cant unless they share a wave
+    std::atomic<int> arrivedCount {0};
+    std::atomic<int> independentCallCount {0};
+    auto const independent = [&](Event const&)
+    {
+        if(++independentCallCount <= 2)
+        {
+            ++arrivedCount;
+            CHECK(waitUntil([&]{ return arrivedCount == 2; }));
+        }
+    };
+
+    auto firstWriter { subscriber.sub<Ping>(writer, {.writes = SHARED_RESOURCE}) };
+    auto secondWriter { subscriber.sub<Ping>(writer, {.writes = SHARED_RESOURCE}) };
+    auto firstIndependent { subscriber.sub<Ping>(independent, {.writes = 1 << 2}) };
+    auto secondIndependent { subscriber.sub<Ping>(independent, {.writes = 1 << 3}) };
+
+    for(int i{0}; i < eventCount; ++i)
+        publisher.enqueue(Ping{i});
+
+    CHECK(eventSys.dispatchQueuedParallel(pool) == eventCount);
+    CHECK(writerCallCount == 2 * eventCount);
+    CHECK(maxWritersInFlight == 1);
+    CHECK(independentCallCount == 2 * eventCount);
+
+    CHECK(subscriber.unsub<Ping>(firstWriter));
+    CHECK(subscriber.unsub<Ping>(secondWriter));
+    CHECK(subscriber.unsub<Ping>(firstIndependent));
+    CHECK(subscriber.unsub<Ping>(secondIndependent));
+}
+
+//Publishes 3 Pings to ID, replaces its callback, publishes 3 more and checks each callback got its 3,
+//for subscriptions that are called off the publishing thread.
+void checkReplacingOffThePublishingThread(TestEventSystem& eventSys, SubscriptionID ID, std::atomic<int>& oldCallCount)
+{
+    auto& subscriber { eventSys.getSubscriber() };
+    auto const& publisher { eventSys.getPublisher() };
+
+    Ping ping;
+    for(int i{0}; i < 3; ++i)
+        publisher.pub(ping);
+
+    CHECK(waitUntil([&]{ return oldCallCount == 3; }));
+
+    std::atomic<int> newCallCount {0};
+    CHECK(subscriber.replace<Ping>(ID, [&](Event const&){ ++newCallCount; }));
+
+    for(int i{0}; i < 3; ++i)
+        publisher.pub(ping);
+
+    CHECK(waitUntil([&]{ return newCallCount == 3; }));
+    CHECK(oldCallCount == 3);
+    CHECK(subscriber.unsub<Ping>(ID));
+}
+
+void replacingAnOffloadedSubscription()
+{
+    TestEventSystem eventSys;
+    ThreadPool pool {2};
+    eventSys.enableOffloading(pool, std::chrono::nanoseconds{1});
+
+    std::atomic<int> oldCallCount {0};
+    auto ID { eventSys.getSubscriber().sub<Ping>([&](Event const&){ ++oldCallCount; }, {.allowOffload = true}) };
+
+    //the first call is timed inline, from then on it takes longer than the threshold
+    Ping ping;
+    eventSys.getPublisher().pub(ping);
+    eventSys.getPublisher().pub(ping);
+    CHECK(eventSys.offloadMetrics<Ping>(ID).isOffloaded);
+    CHECK(waitUntil([&]{ return oldCallCount == 2; }));
+    oldCallCount = 0;
+
+    checkReplacingOffThePublishingThread(eventSys, ID, oldCallCount);
+}
+
+void replacingAMailboxSubscription()
+{
+    TestEventSystem eventSys;
+    ThreadPool pool {2};
+
+    std::atomic<int> oldCallCount {0};
+    auto ID { eventSys.getSubscriber().sub<Ping>([&](Event const&){ ++oldCallCount; }, {.mailboxCapacity = 16, .mailboxPool = &pool}) };
+
+    checkReplacingOffThePublishingThread(eventSys, ID, oldCallCount);
+}
+
+//subConcurrent and unsubConcurrent from several threads while the owning thread subscribes directly.
+void subscribingConcurrently()
+{
+    constexpr int threadCount {4};
+    constexpr int subsPerThread {100};
+
+    TestEventSystem eventSys;
+    auto& subscriber { eventSys.getSubscriber() };
+    auto const& publisher { eventSys.getPublisher() };
+
+    std::atomic<int> callCount {0};
+
+    {
+        std::vector<std::jthread> threads;
+        for(int i{0}; i < threadCount; ++i)
+        {
+            threads.emplace_back([&]
+            {
+                std::vector<SubscriptionID> IDs;
+                for(int j{0}; j < subsPerThread; ++j)
+                    IDs.push_back(subscriber.subConcurrent<Ping>([&](Event const&){ ++callCount; }));
+
+                //every other one is undone in the same combine pass it was made in
+                for(std::size_t j{0}; j < IDs.size(); j += 2)
+                    CHECK(subscriber.unsubConcurrent<Ping>(IDs[j]));
+            });
+        }
+
+        auto direct { subscriber.sub<Pong>([](Event const&){}) };
+        CHECK(direct != INVALID_SUBSCRIPTION_ID);
+    }
+
+    eventSys.applyConcurrentSubscriptions();
+
+    Ping ping;
+    publisher.pub(ping);
+    CHECK(callCount == threadCount * subsPerThread / 2);
+}
+
+//A MultiQueueDispatcher leaves nothing behind in the EventSystems it drained once it is destroyed,
+//even while another thread is enqueueing.
+void enqueueingAfterTheMultiQueueDispatcherIsGone()
+{
+    TestEventSystem eventSys;
+    auto const& publisher { eventSys.getPublisher() };
+
+    std::atomic<bool> isDone {false};
+    std::thread producer {[&]
+    {
+        while(!isDone.load(std::memory_order_relaxed))
+            publisher.enqueue(Ping{1});
+    }};
+
+    {
+        MultiQueueDispatcher dispatcher;
+        dispatcher.add(eventSys);
+        dispatcher.start();
+        publisher.enqueue(Ping{2});
+    }
+
+    publisher.enqueue(Ping{3});
+    isDone = true;
+    producer.join();
+
+    CHECK(eventSys.queuedCount() > 0);
+}
+
+//Each round the flooded queue gets its quantum of 4 and the light one its 2, so the light queue's events come 
+//in pairs after every 4 of the flood instead of waiting for all of it.
+void sharingRoundsByQuantum()
+{
+    TestEventSystem flooded;
+    TestEventSystem light;
+    std::string order;
+
+    auto floodedID { flooded.getSubscriber().sub<Ping>([&](Event const&){ order += 'F'; }) };
+    auto lightID { light.getSubscriber().sub<Ping>([&](Event const&){ order += 'L'; }) };
+
+    for(int i{0}; i < 100; ++i)
+        flooded.getPublisher().enqueue(Ping{i});
+
+    for(int i{0}; i < 6; ++i)
+        light.getPublisher().enqueue(Ping{i});
+
+    MultiQueueDispatcher dispatcher;
+    auto const floodedQueue { dispatcher.add(flooded, 4) };
+    auto const lightQueue { dispatcher.add(light, 2) };
+
+    for(int round{0}; round < 4; ++round)
+        dispatcher.runRound();
+
+    CHECK(order == "FFFFLL" "FFFFLL" "FFFFLL" "FFFF");
+    CHECK(dispatcher.metrics(floodedQueue).dispatchedCount == 16);
+    CHECK(dispatcher.metrics(lightQueue).dispatchedCount == 6);
+    CHECK(dispatcher.metrics(lightQueue).roundsServed == 3);
+    CHECK(dispatcher.metrics(lightQueue).maxBacklog == 6);
+
+    CHECK(flooded.getSubscriber().unsub<Ping>(floodedID));
+    CHECK(light.getSubscriber().unsub<Ping>(lightID));
+}
+
+//Batches follow the backlog up to maxBatchSize, shrink to what fits in the latency ceiling once events get 
+//slow to dispatch, and grow back when they get fast again.
+void sizingBatches()
+{
+    AdaptiveBatchSizer sizer {{.minBatchSize = 1, .maxBatchSize = 1024, .latencyCeiling = std::chrono::microseconds{1000}}};
+
+    CHECK(sizer.take(0) == 0);
+    CHECK(sizer.take(1) == 1);
+    CHECK(sizer.take(500) == 500);
+    CHECK(sizer.take(5000) == 1024);
+
+    sizer.recordDispatchTime(100, std::chrono::microseconds{10});
+    CHECK(sizer.take(5000) == 1024);
+
+    //20 microseconds per event, so 50 fit in the ceiling
+    sizer.recordDispatchTime(100, std::chrono::milliseconds{2});
+    auto const firstSlowBatch { sizer.take(5000) };
+    CHECK(firstSlowBatch < 1024);
+
+    for(int i{0}; i < 30; ++i)
+        sizer.recordDispatchTime(100, std::chrono::milliseconds{2});
+
+    auto const slowBatch { sizer.take(5000) };
+    CHECK(slowBatch < firstSlowBatch);
+    CHECK(slowBatch == 50);
+    CHECK(sizer.take(10) == 10);
+
+    for(int i{0}; i < 30; ++i)
+        sizer.recordDispatchTime(100, std::chrono::microseconds{10});
+
+    CHECK(sizer.take(5000) == 1024);
+
+    auto const metrics { sizer.metrics() };
+    CHECK(metrics.lastBatchSize == 1024);
+    CHECK(metrics.maxBatchSize == 1024);
+    CHECK(metrics.batchCount == 8);
+}
+
+//A dispatchQueued(maxEvents) that reaches into a committed batch dispatches the rest of it too.
+void dispatchingBatchesWhole()
+{
+    TestEventSystem eventSys;
+    auto& subscriber { eventSys.getSubscriber() };
+    auto const& publisher { eventSys.getPublisher() };
+
+    std::string order;
+    auto ping { subscriber.sub<Ping>([&](Event const& e){ order += std::to_string(e.unpack<Ping>().value); }) };
+    auto pong { subscriber.sub<Pong>([&](Event const&){ order += 'P'; }) };
+
+    publisher.enqueue(Ping{0});
+
+    auto batch { publisher.beginBatch() };
+    batch.enqueue(Ping{1});
+    batch.enqueue(Pong{});
+    batch.enqueue(Ping{2});
+    CHECK(batch.commit() == 3);
+    CHECK(batch.size() == 0);
+
+    publisher.enqueue(Ping{3});
+
+    CHECK(eventSys.dispatchQueued(2) == 4);
+    CHECK(order == "01P2");
+
+    CHECK(eventSys.dispatchQueued(1) == 1);
+    CHECK(order == "01P23");
+
+    CHECK(subscriber.unsub<Ping>(ping));
+    CHECK(subscriber.unsub<Pong>(pong));
+}
+
+//Staged events that are never committed are never dispatched.
+void droppingUncommittedBatches()
+{
+    TestEventSystem eventSys;
+    auto& subscriber { eventSys.getSubscriber() };
+    auto const& publisher { eventSys.getPublisher() };
+
+    int callCount {0};
+    auto ID { subscriber.sub<Ping>([&](Event const&){ ++callCount; }) };
+
+    {
+        auto abandoned { publisher.beginBatch() };
+        abandoned.enqueue(Ping{1});
+        abandoned.enqueue(Ping{2});
+    }
+
+    auto discarded { publisher.beginBatch() };
+    discarded.enqueue(Ping{3});
+    discarded.discard();
+    CHECK(discarded.commit() == 0);
+
+    CHECK(eventSys.queuedCount() == 0);
+    CHECK(eventSys.dispatchQueued() == 0);
+    CHECK(callCount == 0);
+
+    CHECK(subscriber.unsub<Ping>(ID));
+}
+
+//Threads that exit give their ring back for the next thread, and a thread that switches between recorders
+//keeps its ring in each.
+void reusingFlightRecorderRings()
+{
+    auto const directory { std::filesystem::temp_directory_path() };
+    FlightRecorder first {directory / "EventSysTestsFirst.bin", {1, 64, 8}};
+    FlightRecorder second {directory / "EventSysTestsSecond.bin", {1, 64, 8}};
+
+    std::byte const payload[8] {};
+
+    for(int i{0}; i < 3; ++i)
+    {
+        std::thread{[&]
+        {
+            first.record(0, payload);
+            second.record(1, payload);
+            first.record(0, payload);
+        }}.join();
+    }
+
+    CHECK(first.droppedCount() == 0);
+    CHECK(second.droppedCount() == 0);
+
+    //the threads above have all exited, so this one gets the ring
+    first.record(0, payload);
+    CHECK(first.droppedCount() == 0);
+
+    std::thread{[&]{ first.record(0, payload); }}.join();
+    CHECK(first.droppedCount() == 1); //this thread still holds the only ring
+}
+
+//A list goes back and forth between the plain publishing path and the one for call limits and pausing.
+void switchingBetweenPlainAndSpecialSubscriptions()
+{
+    TestEventSystem eventSys;
+    auto& subscriber { eventSys.getSubscriber() };
+    auto const& publisher { eventSys.getPublisher() };
+
+    int plainCallCount {0};
+    int onceCallCount {0};
+
+    auto plain { subscriber.sub<Ping>([&](Event const&){ ++plainCallCount; }) };
+    (void)subscriber.subOnce<Ping>([&](Event const&){ ++onceCallCount; });
+
+    Ping ping;
+    publisher.pub(ping);
+    publisher.pub(ping);
+    CHECK(plainCallCount == 2);
+    CHECK(onceCallCount == 1);
+
+    eventSys.pause<Ping>();
+    publisher.pub(ping);
+    CHECK(plainCallCount == 2);
+
+    eventSys.resume<Ping>();
+    CHECK(plainCallCount == 3);
+
+    auto unsubscribing { subscriber.sub<Ping>([&](Event const&){ (void)subscriber.unsub<Ping>(plain); }) };
+    publisher.pub(ping);
+    publisher.pub(ping);
+    CHECK(plainCallCount == 4); //it was before the one that unsubscribed it in the first pub
+    CHECK(subscriber.unsub<Ping>(unsubscribing));
+}
+
+//A compiled out type in the middle of the others has no state of its own, so the types after it have to find theirs.
+void compiledOutTypesBetweenOthers()
+{
+    EventSystem<Ping, CompiledOut, Pong> eventSys;
+    auto& subscriber { eventSys.getSubscriber() };
+    auto const& publisher { eventSys.getPublisher() };
+
+    int pingCallCount {0};
+    int pongCallCount {0};
+
+    auto ping { subscriber.sub<Ping>([&](Event const&){ ++pingCallCount; }) };
+    auto pong { subscriber.sub<Pong>([&](Event const&){ ++pongCallCount; }) };
+    CHECK(subscriber.sub<CompiledOut>([](Event const&){}) == INVALID_SUBSCRIPTION_ID);
+
+    eventSys.pause<Pong>();
+    publisher.enqueue(Pong{});
+    publisher.enqueue(CompiledOut{});
+    publisher.enqueue(Ping{});
+    eventSys.dispatchQueued();
+    CHECK(pingCallCount == 1);
+    CHECK(pongCallCount == 0);
+
+    eventSys.resume<Pong>();
+    CHECK(pongCallCount == 1);
+    CHECK(eventSys.deadlineMetrics<CompiledOut>().metCount == 0);
+
+    CHECK(subscriber.unsub<Ping>(ping));
+    CHECK(subscriber.unsub<Pong>(pong));
+}
+
+void droppingDuplicatesWithinTheWindow()
+{
+    TestEventSystem eventSys;
+    auto& subscriber { eventSys.getSubscriber() };
+    auto const& publisher { eventSys.getPublisher() };
+
+    int callCount {0};
+    auto ID { subscriber.sub<Ping>([&](Event const&){ ++callCount; }) };
+    eventSys.dedup<Ping>(std::chrono::hours{1}, [](Ping const& ping){ return static_cast<std::uint64_t>(ping.value); });
+
+    Ping first {1};
+    Ping again {1};
+    Ping second {2};
+    publisher.pub(first);
+    publisher.pub(again);
+    publisher.pub(second);
+    publisher.enqueue(Ping{2});
+    eventSys.dispatchQueued();
+
+    CHECK(callCount == 2);
+    CHECK(eventSys.droppedDuplicateCount<Ping>() == 2);
+
+    eventSys.dedup<Ping>(std::chrono::hours{0}, {});
+    publisher.pub(again);
+    CHECK(callCount == 3);
+
+    CHECK(subscriber.unsub<Ping>(ID));
+}
+
+//A key is let through again once window has passed since it last was, and that starts a new window.
+void forgettingExpiredKeys()
+{
+    DedupTable table {std::chrono::seconds{10}};
+    auto const start { std::chrono::steady_clock::time_point{} + std::chrono::hours{1} };
+
+    CHECK(!table.isDuplicate(5, start));
+    CHECK(table.isDuplicate(5, start + std::chrono::seconds{9}));
+    CHECK(!table.isDuplicate(5, start + std::chrono::seconds{10}));
+    CHECK(table.isDuplicate(5, start + std::chrono::seconds{19}));
+    CHECK(!table.isDuplicate(6, start + std::chrono::seconds{19}));
+    CHECK(table.droppedCount() == 2);
+}
+
+//Keys that all hash to the first of 8 slots, so they fill the table in this order. 
+//Once the first one expires its slot must not hide the live keys behind it.
+void findingKeysPastExpiredSlots()
+{
+    constexpr std::array<std::uint64_t, 8> collidingKeys {7, 15, 23, 30, 38, 46, 54, 61};
+    DedupTable table {std::chrono::seconds{10}, collidingKeys.size()};
+    auto const start { std::chrono::steady_clock::time_point{} + std::chrono::hours{1} };
+
+    CHECK(!table.isDuplicate(collidingKeys[0], start));
+
+    for(std::size_t i{1}; i < collidingKeys.size(); ++i)
+        CHECK(!table.isDuplicate(collidingKeys[i], start + std::chrono::seconds{5}));
+
+    for(std::size_t i{1}; i < collidingKeys.size(); ++i)
+        CHECK(table.isDuplicate(collidingKeys[i], start + std::chrono::seconds{12}));
+
+    CHECK(!table.isDuplicate(collidingKeys[0], start + std::chrono::seconds{12}));
+    CHECK(table.isDuplicate(collidingKeys[0], start + std::chrono::seconds{13}));
+    CHECK(table.droppedCount() == collidingKeys.size());
+}
+
+//The reply goes to the onReply of its request, not to the subscribers of its type, and only once.
+void replyingToARequest()
+{
+    RequestEventSystem eventSys;
+    auto& subscriber { eventSys.getSubscriber() };
+    auto const& publisher { eventSys.getPublisher() };
+
+    CorrelationID answeredID {INVALID_CORRELATION_ID};
+    auto responder { subscriber.sub<Question>([&](Event const& e)
+    {
+        auto const& question { e.unpack<Question>() };
+        answeredID = question.correlationID;
+        publisher.reply(question.correlationID, Answer{question.value * 2});
+    }) };
+
+    int broadcastCount {0};
+    auto listener { subscriber.sub<Answer>([&](Event const&){ ++broadcastCount; }) };
+
+    std::vector<int> replies;
+    bool hasExpired {false};
+    Question question {21};
+    auto const ID
+    { 
+        publisher.request<Question, Answer>(question, [&](Event const& e){ replies.push_back(e.unpack<Answer>().value); }, 
+            std::chrono::hours{1}, [&]{ hasExpired = true; }) 
+    };
+
+    CHECK(ID != INVALID_CORRELATION_ID);
+    CHECK(answeredID == ID);
+    CHECK(replies.empty());
+
+    eventSys.dispatchQueued();
+    CHECK((replies == std::vector{42}));
+
+    publisher.reply(ID, Answer{0});
+    eventSys.dispatchQueued();
+    CHECK(replies.size() == 1);
+    CHECK(broadcastCount == 0);
+    CHECK(!hasExpired);
+
+    CHECK(subscriber.unsub<Question>(responder));
+    CHECK(subscriber.unsub<Answer>(listener));
+}
+
+//With nobody to answer, the request expires on the dispatchQueued after its timeout and a late reply is dropped.
+void expiringAnUnansweredRequest()
+{
+    RequestEventSystem eventSys;
+    auto const& publisher { eventSys.getPublisher() };
+
+    int replyCount {0};
+    int expiredCount {0};
+    Question question {1};
+    auto const ID
+    {
+        publisher.request<Question, Answer>(question, [&](Event const&){ ++replyCount; }, 
+            std::chrono::steady_clock::duration::zero(), [&]{ ++expiredCount; })
+    };
+
+    CHECK(ID != INVALID_CORRELATION_ID);
+    CHECK(expiredCount == 0);
+
+    eventSys.dispatchQueued();
+    CHECK(expiredCount == 1);
+
+    publisher.reply(ID, Answer{2});
+    eventSys.dispatchQueued();
+    CHECK(replyCount == 0);
+    CHECK(expiredCount == 1);
+}
+
+void projectingASequenceOfEvents()
+{
+    TestEventSystem eventSys;
+    auto& subscriber { eventSys.getSubscriber() };
+    auto const& publisher { eventSys.getPublisher() };
+
+    auto const parityOf = [](Ping const& ping){ return ping.value % 2; };
+    auto const valueOf = [](Ping const& ping){ return ping.value; };
+
+    Projection<std::unordered_map<int, std::size_t>> countPerParity;
+    Projection<std::unordered_map<int, int>> latestPerParity;
+    Projection<std::vector<int>> topTwo;
+
+    auto count { subscriber.project<Ping>(countPerParity, countByKey(parityOf)) };
+    auto latest { subscriber.project<Ping>(latestPerParity, latestByKey(parityOf, valueOf)) };
+    auto top { subscriber.project<Ping>(topTwo, topN(2, valueOf)) };
+
+    for(int value : {3, 8, 1, 6, 5})
+    {
+        Ping ping {value};
+        publisher.pub(ping);
+    }
+
+    CHECK((countPerParity.snapshot() == std::unordered_map<int, std::size_t>{{0, 2}, {1, 3}}));
+    CHECK((latestPerParity.snapshot() == std::unordered_map<int, int>{{0, 6}, {1, 5}}));
+    CHECK((topTwo.snapshot() == std::vector{8, 6}));
+    CHECK(topTwo.read([](std::vector<int> const& values){ return values.front(); }) == 8);
+
+    CHECK(subscriber.unsub<Ping>(count));
+    CHECK(subscriber.unsub<Ping>(latest));
+    CHECK(subscriber.unsub<Ping>(top));
+}
+
+//A projection starts from its initial state and only folds what is published after it was attached.
+void projectingAfterEventsWerePublished()
+{
+    TestEventSystem eventSys;
+    auto& subscriber { eventSys.getSubscriber() };
+    auto const& publisher { eventSys.getPublisher() };
+
+    Ping ping {1};
+    publisher.pub(ping);
+    publisher.pub(ping);
+
+    Projection<int> sum {100};
+    auto ID { subscriber.project<Ping>(sum, [](int& total, Ping const& e){ total += e.value; }) };
+    CHECK(sum.snapshot() == 100);
+
+    Ping later {5};
+    publisher.pub(later);
+    publisher.enqueue(Ping{7});
+    eventSys.dispatchQueued();
+    CHECK(sum.snapshot() == 112);
+
+    CHECK(subscriber.unsub<Ping>(ID));
+    publisher.pub(later);
+    CHECK(sum.snapshot() == 112);
+}
+
+//Who got which event, in order, for comparing a StaticEventSystem with an EventSystem.
+static std::vector<std::string> gDeliveries;
+
+void recordFirst(Ping const& e) { gDeliveries.push_back("first " + std::to_string(e.value)); }
+void recordSecond(Ping const& e) { gDeliveries.push_back("second " + std::to_string(e.value)); }
+void recordPong(Pong const&) { gDeliveries.push_back("pong"); }
+
+using TestStaticEventSystem = StaticEventSystem
+<
+    StaticHandlers<StaticHandler<Ping, &recordFirst>, StaticHandler<Pong, &recordPong>, StaticHandler<Ping, &recordSecond>>, 
+    Ping, Pong
+>;
+
+//Publishes the same events through eventSys, which has a dynamic "third" subscription to Ping after whatever it already has.
+template <typename EventSys>
+std::vector<std::string> recordDeliveries(EventSys& eventSys)
+{
+    gDeliveries.clear();
+
+    auto& subscriber { eventSys.getSubscriber() };
+    auto const& publisher { eventSys.getPublisher() };
+    auto third { subscriber.template sub<Ping>([](Event const& e){ gDeliveries.push_back("third " + std::to_string(e.unpack<Ping>().value)); }) };
+
+    Ping ping {1};
+    Pong pong;
+    publisher.pub(ping);
+    publisher.pub(pong);
+    publisher.enqueue(Ping{2});
+    publisher.enqueue(Pong{});
+    publisher.enqueue(Ping{3});
+    eventSys.dispatchQueued();
+
+    CHECK(subscriber.template unsub<Ping>(third));
+    return std::exchange(gDeliveries, {});
+}
+
+//Static handlers are called in the order they are listed and before the dynamic subscriptions, 
+//which is the order the same handlers get in an EventSystem when they are subscribed first.
+void deliveringInTheSameOrderStatically()
+{
+    TestStaticEventSystem staticEventSys;
+    auto const staticOrder { recordDeliveries(staticEventSys) };
+
+    TestEventSystem eventSys;
+    auto& subscriber { eventSys.getSubscriber() };
+    auto first { subscriber.sub<Ping>([](Event const& e){ recordFirst(e.unpack<Ping>()); }) };
+    auto pong { subscriber.sub<Pong>([](Event const& e){ recordPong(e.unpack<Pong>()); }) };
+    auto second { subscriber.sub<Ping>([](Event const& e){ recordSecond(e.unpack<Ping>()); }) };
+    auto const dynamicOrder { recordDeliveries(eventSys) };
+
+    CHECK(staticOrder.size() == 11);
+    CHECK(staticOrder == dynamicOrder);
+
+    CHECK(subscriber.unsub<Ping>(first));
+    CHECK(subscriber.unsub<Pong>(pong));
+    CHECK(subscriber.unsub<Ping>(second));
+}
+
+//Publishes one of each type of a CategoryEventSystem and returns what the subscriptions appended to calls.
+std::string publishOneOfEach(CategoryEventSystem const& eventSys, std::string& calls)
+{
+    calls.clear();
+    auto const& publisher { eventSys.getPublisher() };
+
+    KeyPressed key;
+    Ping ping;
+    MouseMoved mouse;
+    PacketReceived packet;
+    publisher.pub(key);
+    publisher.pub(ping);
+    publisher.pub(mouse);
+    publisher.pub(packet);
+
+    return calls;
+}
+
+//A subCategory subscription gets every type in its categories, and unsubCategory takes it out of all of them.
+void subscribingToCategories()
+{
+    CategoryEventSystem eventSys;
+    auto& subscriber { eventSys.getSubscriber() };
+
+    std::string calls;
+    auto const record = [&calls](Event const& e)
+    {
+        if(dynamic_cast<KeyPressed const*>(&e)) calls += 'K';
+        else if(dynamic_cast<Ping const*>(&e)) calls += 'P';
+        else if(dynamic_cast<MouseMoved const*>(&e)) calls += 'M';
+        else if(dynamic_cast<PacketReceived const*>(&e)) calls += 'N';
+    };
+
+    auto input { subscriber.subCategory(INPUT_EVENTS, record) };
+    CHECK(publishOneOfEach(eventSys, calls) == "KM");
+
+    auto everything { subscriber.subCategory(INPUT_EVENTS | NETWORK_EVENTS, record) };
+    CHECK(publishOneOfEach(eventSys, calls) == "KKMMN");
+
+    CHECK(subscriber.unsubCategory(input));
+    CHECK(input == INVALID_SUBSCRIPTION_ID);
+    CHECK(publishOneOfEach(eventSys, calls) == "KMN");
+
+    CHECK(subscriber.unsubCategory(everything));
+    CHECK(!subscriber.unsubCategory(everything));
+    CHECK(publishOneOfEach(eventSys, calls).empty());
+
+    CHECK(subscriber.subCategory(1 << 5, record) == INVALID_SUBSCRIPTION_ID);
+
+#ifdef NDEBUG
+    //unsub for one type would orphan the copies in the others, so release builds refuse it (debug builds assert)
+    auto category { subscriber.subCategory(INPUT_EVENTS, record) };
+    auto const categoryID { category };
+    CHECK(!subscriber.unsub<KeyPressed>(category));
+    CHECK(category == categoryID);
+    CHECK(publishOneOfEach(eventSys, calls) == "KM");
+    CHECK(subscriber.unsubCategory(category));
+#endif
+}
+
+//An empty directory for an EventLog, removed again when this goes out of scope.
+struct LogDirectory
+{
+    LogDirectory() { std::filesystem::remove_all(path); }
+    ~LogDirectory() { std::filesystem::remove_all(path); }
+
+    std::filesystem::path const path { std::filesystem::temp_directory_path() / "EventSysTestsLog" };
+};
+
+//Replays the log in directory into a fresh EventSystem, returning the values of the replayed Pings.
+std::vector<int> replayPings(std::filesystem::path const& directory, int* snapshotState = nullptr)
+{
+    TestEventSystem eventSys;
+    std::vector<int> values;
+    auto ID { eventSys.getSubscriber().sub<Ping>([&](Event const& e){ values.push_back(e.unpack<Ping>().value); }) };
+
+    TestEventLog log {eventSys, directory};
+    auto const replayedCount { log.replay([&](std::span<std::byte const> bytes)
+    {
+        CHECK(snapshotState != nullptr);
+        if(snapshotState)
+            *snapshotState = readBytes<int>(bytes);
+    }) };
+
+    CHECK(replayedCount == values.size());
+    CHECK(log.loggedCount() == 0);
+    CHECK(eventSys.getSubscriber().unsub<Ping>(ID));
+    return values;
+}
+
+//Replay gives the snapshot the state it was saved with, then only the events logged after it.
+void replayingFromASnapshot()
+{
+    LogDirectory directory;
+    {
+        TestEventSystem eventSys;
+        auto const& publisher { eventSys.getPublisher() };
+        TestEventLog log {eventSys, directory.path};
+
+        int sum {0};
+        for(int value{1}; value <= 3; ++value)
+        {
+            Ping ping {value};
+            publisher.pub(ping);
+            sum += value;
+        }
+
+        log.snapshot([&](std::vector<std::byte>& out){ appendBytes(out, sum); });
+
+        for(int value{4}; value <= 5; ++value)
+        {
+            Ping ping {value};
+            publisher.pub(ping);
+        }
+
+        CHECK(log.loggedCount() == 5);
+    }
+
+    int snapshotState {0};
+    CHECK((replayPings(directory.path, &snapshotState) == std::vector{4, 5}));
+    CHECK(snapshotState == 6);
+}
+
+//A record cut short by a crash in the middle of a write is dropped, along with nothing before it.
+void skippingATornRecord()
+{
+    LogDirectory directory;
+    {
+        TestEventSystem eventSys;
+        TestEventLog log {eventSys, directory.path};
+
+        for(int value{1}; value <= 3; ++value)
+        {
+            Ping ping {value};
+            eventSys.getPublisher().pub(ping);
+        }
+    }
+
+    std::vector<std::filesystem::path> segments;
+    for(auto const& file : std::filesystem::directory_iterator{directory.path})
+        segments.push_back(file.path());
+
+    CHECK(segments.size() == 1);
+    std::filesystem::resize_file(segments.front(), std::filesystem::file_size(segments.front()) - 1);
+
+    CHECK((replayPings(directory.path) == std::vector{1, 2}));
+}
+
+//Every templated API has to compile and do nothing for a compiled out type.
+void usingEveryApiWithACompiledOutType()
+{
+    EventSystem<Ping, CompiledOut, Pong> eventSys;
+    auto& subscriber { eventSys.getSubscriber() };
+    auto const& publisher { eventSys.getPublisher() };
+    ThreadPool pool {1};
+
+    int callCount {0};
+    auto onEvent { [&](Event const&){ ++callCount; } };
+    CompiledOut e;
+
+    eventSys.dedup<CompiledOut>(std::chrono::seconds{1}, [](CompiledOut const&){ return std::uint64_t{1}; });
+    CHECK(eventSys.droppedDuplicateCount<CompiledOut>() == 0);
+    eventSys.pause<CompiledOut>();
+    eventSys.resume<CompiledOut>();
+    CHECK(eventSys.deadlineMetrics<CompiledOut>().metCount == 0);
+    CHECK(!eventSys.offloadMetrics<CompiledOut>(1).isOffloaded);
+    CHECK(eventSys.mailboxMetrics<CompiledOut>(1).postedCount == 0);
+
+    CHECK(subscriber.sub<CompiledOut>(onEvent, SubscriptionOptions{}) == INVALID_SUBSCRIPTION_ID);
+    CHECK(subscriber.subOnce<CompiledOut>(onEvent) == INVALID_SUBSCRIPTION_ID);
+    CHECK(subscriber.subN<CompiledOut>(onEvent, 2) == INVALID_SUBSCRIPTION_ID);
+    CHECK(subscriber.subConcurrent<CompiledOut>(onEvent) == INVALID_SUBSCRIPTION_ID);
+    CHECK(!subscriber.replace<CompiledOut>(1, onEvent));
+
+    subscriber.reserveSubTo<CompiledOut>(4);
+    auto entityID { subscriber.subTo<CompiledOut>(7, onEvent) };
+    CHECK(entityID == INVALID_SUBSCRIPTION_ID);
+    CHECK(!subscriber.unsubTo<CompiledOut>(7, entityID));
+
+    SubscriptionID ID {1};
+    CHECK(!subscriber.unsub<CompiledOut>(ID));
+    CHECK(!subscriber.unsubConcurrent<CompiledOut>(ID));
+
+    auto const channel { publisher.channel<CompiledOut>() };
+    CHECK(channel.sub(onEvent) == INVALID_SUBSCRIPTION_ID);
+    channel.pub(e);
+
+    publisher.pub(e);
+    publisher.pubParallel(e, pool);
+    publisher.pubShared(e);
+    publisher.pubTo(7, e);
+    publisher.emplacePub<CompiledOut>();
+    publisher.enqueue(CompiledOut{});
+    publisher.enqueue(CompiledOut{}, std::chrono::steady_clock::now());
+    eventSys.dispatchQueued();
+
+    CHECK(callCount == 0);
+}
+
+//A deadline event whose type is paused when its turn comes has not been handled, so it has not met its deadline.
+void holdingDeadlineEvents()
+{
+    TestEventSystem eventSys;
+    auto& subscriber { eventSys.getSubscriber() };
+    auto const& publisher { eventSys.getPublisher() };
+
+    int callCount {0};
+    auto ID { subscriber.sub<Ping>([&](Event const&){ ++callCount; }) };
+
+    eventSys.pause<Ping>();
+    publisher.enqueue(Ping{1}, std::chrono::steady_clock::now() + std::chrono::hours{1});
+    eventSys.dispatchQueued();
+
+    auto const metrics { eventSys.deadlineMetrics<Ping>() };
+    CHECK(metrics.metCount == 0);
+    CHECK(metrics.heldCount == 1);
+    CHECK(callCount == 0);
+
+    eventSys.resume<Ping>();
+    CHECK(callCount == 1);
+    CHECK(subscriber.unsub<Ping>(ID));
+}
+
+//A coalesced paused type keeps only its latest event, published or queued, and delivers just that on resume.
+void coalescingPausedEvents()
+{
+    TestEventSystem eventSys;
+    auto& subscriber { eventSys.getSubscriber() };
+    auto const& publisher { eventSys.getPublisher() };
+
+    std::vector<int> delivered;
+    auto ID { subscriber.sub<Ping>([&](Event const& e){ delivered.push_back(e.unpack<Ping>().value); }) };
+
+    eventSys.pause<Ping>({.coalesce = true});
+
+    for(int value{1}; value <= 3; ++value)
+    {
+        Ping ping {value};
+        publisher.pub(ping);
+    }
+
+    publisher.enqueue(Ping{4});
+    eventSys.dispatchQueued();
+    Ping ping {5};
+    publisher.pub(ping);
+    publisher.enqueue(Ping{6});
+    eventSys.dispatchQueued();
+    CHECK(delivered.empty());
+
+    eventSys.resume<Ping>();
+    CHECK((delivered == std::vector{6}));
+
+    Ping afterResume {7};
+    publisher.pub(afterResume);
+    CHECK((delivered == std::vector{6, 7}));
+
+    CHECK(subscriber.unsub<Ping>(ID));
+}
+
+//Whatever order they were enqueued in, deadline events come out earliest deadline first, ahead of the plain ones.
+void dispatchingByEarliestDeadline()
+{
+    auto const now { std::chrono::steady_clock::now() };
+    std::array<int, 3> hoursLeft {3, 1, 2};
+    std::ranges::sort(hoursLeft);
+
+    do
+    {
+        TestEventSystem eventSys;
+        auto& subscriber { eventSys.getSubscriber() };
+        auto const& publisher { eventSys.getPublisher() };
+
+        std::vector<int> order;
+        auto ID { subscriber.sub<Ping>([&](Event const& e){ order.push_back(e.unpack<Ping>().value); }) };
+
+        publisher.enqueue(Ping{0});
+        for(auto const hours : hoursLeft)
+            publisher.enqueue(Ping{hours}, now + std::chrono::hours{hours});
+
+        CHECK(eventSys.dispatchQueued() == 4);
+        CHECK((order == std::vector{1, 2, 3, 0}));
+        CHECK(eventSys.deadlineMetrics<Ping>().metCount == 3);
+
+        CHECK(subscriber.unsub<Ping>(ID));
+    } while(std::ranges::next_permutation(hoursLeft).found);
+}
+
+//Events past their deadline are dropped and counted with DeadlineMissPolicy::drop, and delivered late otherwise.
+void droppingEventsPastTheirDeadline()
+{
+    TestEventSystem eventSys;
+    auto& subscriber { eventSys.getSubscriber() };
+    auto const& publisher { eventSys.getPublisher() };
+
+    std::vector<int> delivered;
+    auto ID { subscriber.sub<Ping>([&](Event const& e){ delivered.push_back(e.unpack<Ping>().value); }) };
+
+    auto const now { std::chrono::steady_clock::now() };
+    publisher.enqueue(Ping{1}, now - std::chrono::seconds{2}, DeadlineMissPolicy::drop);
+    publisher.enqueue(Ping{2}, now - std::chrono::seconds{1}, DeadlineMissPolicy::deliverLate);
+    publisher.enqueue(Ping{3}, now - std::chrono::seconds{1}, DeadlineMissPolicy::drop);
+    publisher.enqueue(Ping{4}, now + std::chrono::hours{1}, DeadlineMissPolicy::drop);
+    eventSys.dispatchQueued();
+
+    CHECK((delivered == std::vector{2, 4}));
+
+    auto const metrics { eventSys.deadlineMetrics<Ping>() };
+    CHECK(metrics.droppedCount == 2);
+    CHECK(metrics.missedCount == 1);
+    CHECK(metrics.metCount == 1);
+    CHECK(eventSys.queuedCount() == 0);
+
+    CHECK(subscriber.unsub<Ping>(ID));
+}
+
+int main()
+{
+    subscribingFromACallback();
+    unsubscribingAPendingSubscription();
+    unsubscribingFromACallback();
+    replacingFromACallback();
+    replacingOutsideACallback();
+    publishingFromACallback();
+    subscribingToAnEntityFromACallback();
+    enqueueingAfterTheMultiQueueDispatcherIsGone();
+    sharingRoundsByQuantum();
+    sizingBatches();
+    dispatchingBatchesWhole();
+    droppingUncommittedBatches();
+    reusingFlightRecorderRings();
+    switchingBetweenPlainAndSpecialSubscriptions();
+    compiledOutTypesBetweenOthers();
+    usingEveryApiWithACompiledOutType();
+    droppingDuplicatesWithinTheWindow();
+    forgettingExpiredKeys();
+    findingKeysPastExpiredSlots();
+    projectingASequenceOfEvents();
+    projectingAfterEventsWerePublished();
+    deliveringInTheSameOrderStatically();
+    subscribingToCategories();
+    replyingToARequest();
+    expiringAnUnansweredRequest();
+    replayingFromASnapshot();
+    skippingATornRecord();
+    holdingDeadlineEvents();
+    coalescingPausedEvents();
+    dispatchingByEarliestDeadline();
+    droppingEventsPastTheirDeadline();
+
+    publishingFromShards();
+    publishingInParallel();
+#ifndef _WIN32
+    publishingFromSignals();
+#endif
+    deliveringToMailboxes();
+    dispatchingInWaves();
+    offloadingExpensiveSubscriptions();
+    unsubscribingWhileOffloadedCallsRun();
+    replacingAnOffloadedSubscription();
+    replacingAMailboxSubscription();
+    subscribingConcurrently();
+
+    if(gFailureCount > 0)
+    {
+        std::cerr << gFailureCount << " checks failed\n";
+        return 1;
+    }
+
+    std::cout << "All checks passed\n";
+}
@@ -10,13 +10,22 @@ struct EventType2 : Event {};
 struct EventType3 : Event {};
 struct EventType4 : Event {};
 
-using MyEventSystem = EventSystem<EventType1, EventType2, EventType3, EventType4>;
+//Only exists in editor builds. Everywhere else it is compiled out, so publishing it compiles to nothing
+//and the EventSystem keeps no state for it.
+struct EditorSelectionChanged : Event {};
+
+#ifndef EDITOR_BUILD
+template <> struct CompileOutEvent<EditorSelectionChanged> : std::true_type {};
+#endif
+
+using MyEventSystem = EventSystem<EventType1, EventType2, EventType3, EventType4, EditorSelectionChanged>;
 
 enum struct SubscriptionTypes
 {
     EVENT_TYPE_1,
     EVENT_TYPE_2,
-    EVENT_TYPE_4
+    EVENT_TYPE_4,
+    EDITOR_SELECTION_CHANGED
 };
 
 using MySubscriptionManager = SubscriptionManager<SubscriptionTypes, MyEventSystem::Subscriber>;
@@ -47,6 +56,10 @@ int main()
     EventType3 e3{};
     publisher.pub(e3);
 
+    //prints nothing unless this was built with EDITOR_BUILD defined
+    EditorSelectionChanged selectionChanged{};
+    publisher.pub(selectionChanged);
+
     //now we are no longer subscribed to the subscription associated with EVENT_TYPE_2
     subManager.unsub(SubscriptionTypes::EVENT_TYPE_2);
 
@@ -76,4 +89,10 @@ void subToEvents(MySubscriptionManager& subManager)
     {
         std::cout << "EventType4 has been published!\n";
     });
+
+    //nothing is subscribed or stored when EditorSelectionChanged is compiled out
+    subManager.sub<EditorSelectionChanged>(SubscriptionTypes::EDITOR_SELECTION_CHANGED, [](Event const&)
+    {
+        std::cout << "EditorSelectionChanged has been published!\n";
+    });
 }
\ No newline at end of file
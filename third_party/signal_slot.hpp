@@ -0,0 +1,225 @@
+// signal_slot.hpp - a small header-only signal/slot library
+//
+// Single header, C++17, no dependencies beyond the standard library. It follows the usual design of the
+// common signal libraries (sigslot, nano-signal-slot, boost::signals2 without the threading):
+//
+//   signal_slot::signal<void(int)> sig;
+//   signal_slot::connection c = sig.connect([](int x) { ... });
+//   sig(42);          // call every connected slot, in the order they were connected
+//   c.disconnect();   // or hold a scoped_connection, which disconnects when destroyed
+//
+// A slot may connect and disconnect slots (itself included) while the signal is being emitted. Slots
+// connected during an emission are first called by the next one, slots disconnected during it are not
+// called anymore. A signal is not thread safe, emit and (dis)connect it from one thread at a time.
+//
+// Kept in this repository as the reference signal/slot implementation that Benchmark.cpp compares with.
+//
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace signal_slot {
+
+namespace detail {
+
+class slot_owner
+{
+public:
+    virtual void slot_disconnected() noexcept = 0;
+
+protected:
+    ~slot_owner() = default;
+};
+
+class slot_base
+{
+public:
+    explicit slot_base(slot_owner& owner) noexcept : m_owner{&owner} {}
+    virtual ~slot_base() = default;
+
+    slot_base(slot_base const&) = delete;
+    slot_base& operator=(slot_base const&) = delete;
+
+    bool connected() const noexcept { return m_owner != nullptr; }
+
+    void disconnect() noexcept
+    {
+        if (auto* owner = std::exchange(m_owner, nullptr))
+            owner->slot_disconnected();
+    }
+
+    // the signal is going away, there is nobody left to tell
+    void orphan() noexcept { m_owner = nullptr; }
+
+private:
+    slot_owner* m_owner;
+};
+
+} // namespace detail
+
+// A handle to one connected slot. Copies refer to the same slot, and it is safe to use after the
+// signal is gone (it is disconnected then).
+class connection
+{
+public:
+    connection() = default;
+
+    bool connected() const noexcept
+    {
+        auto const slot = m_slot.lock();
+        return slot && slot->connected();
+    }
+
+    void disconnect() noexcept
+    {
+        if (auto const slot = m_slot.lock())
+            slot->disconnect();
+    }
+
+private:
+    template <typename>
+    friend class signal;
+
+    explicit connection(std::weak_ptr<detail::slot_base> slot) noexcept : m_slot{std::move(slot)} {}
+
+    std::weak_ptr<detail::slot_base> m_slot;
+};
+
+// Disconnects its slot when it is destroyed or assigned over.
+class scoped_connection
+{
+public:
+    scoped_connection() = default;
+    scoped_connection(connection c) noexcept : m_connection{std::move(c)} {}
+    ~scoped_connection() { m_connection.disconnect(); }
+
+    scoped_connection(scoped_connection&& other) noexcept : m_connection{std::exchange(other.m_connection, {})} {}
+
+    scoped_connection& operator=(scoped_connection&& other) noexcept
+    {
+        if (this != &other)
+        {
+            m_connection.disconnect();
+            m_connection = std::exchange(other.m_connection, {});
+        }
+        return *this;
+    }
+
+    scoped_connection(scoped_connection const&) = delete;
+    scoped_connection& operator=(scoped_connection const&) = delete;
+
+    bool connected() const noexcept { return m_connection.connected(); }
+    void disconnect() noexcept { m_connection.disconnect(); }
+
+    // give up ownership without disconnecting
+    connection release() noexcept { return std::exchange(m_connection, {}); }
+
+private:
+    connection m_connection;
+};
+
+template <typename Signature>
+class signal;
+
+template <typename... Args>
+class signal<void(Args...)> final : private detail::slot_owner
+{
+public:
+    signal() = default;
+    ~signal() { disconnect_all(); }
+
+    signal(signal const&) = delete;
+    signal& operator=(signal const&) = delete;
+
+    template <typename Callable, typename = std::enable_if_t<std::is_invocable_v<Callable&, Args...>>>
+    connection connect(Callable&& callable)
+    {
+        auto slot = std::make_shared<slot_impl>(static_cast<detail::slot_owner&>(*this), std::forward<Callable>(callable));
+        connection c{slot};
+        m_slots.push_back(std::move(slot));
+        return c;
+    }
+
+    void operator()(Args... args)
+    {
+        emission_guard const guard{*this};
+
+        // by index and up to the current size: slots connected from a slot go to the back and may reallocate
+        auto const count = m_slots.size();
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            auto* const slot = m_slots[i].get();
+            if (slot->connected())
+                slot->function(args...);
+        }
+    }
+
+    void disconnect_all() noexcept
+    {
+        for (auto const& slot : m_slots)
+            slot->orphan();
+
+        if (m_emission_depth == 0)
+            m_slots.clear();
+        else
+            m_has_disconnected_slots = true;
+    }
+
+    std::size_t slot_count() const noexcept
+    {
+        return static_cast<std::size_t>(std::count_if(m_slots.begin(), m_slots.end(), [](auto const& slot) { return slot->connected(); }));
+    }
+
+    bool empty() const noexcept { return slot_count() == 0; }
+
+private:
+    struct slot_impl final : detail::slot_base
+    {
+        template <typename Callable>
+        slot_impl(detail::slot_owner& owner, Callable&& callable) : slot_base{owner}, function{std::forward<Callable>(callable)} {}
+
+        std::function<void(Args...)> function;
+    };
+
+    // disconnected slots stay in the list until no emission is walking it
+    struct emission_guard
+    {
+        explicit emission_guard(signal& s) noexcept : sig{s} { ++sig.m_emission_depth; }
+
+        ~emission_guard()
+        {
+            if (--sig.m_emission_depth == 0 && sig.m_has_disconnected_slots)
+                sig.remove_disconnected();
+        }
+
+        signal& sig;
+    };
+
+    void slot_disconnected() noexcept override
+    {
+        if (m_emission_depth == 0)
+            remove_disconnected();
+        else
+            m_has_disconnected_slots = true;
+    }
+
+    void remove_disconnected() noexcept
+    {
+        m_slots.erase(std::remove_if(m_slots.begin(), m_slots.end(), [](auto const& slot) { return !slot->connected(); }), m_slots.end());
+        m_has_disconnected_slots = false;
+    }
+
+    std::vector<std::shared_ptr<slot_impl>> m_slots;
+    std::size_t m_emission_depth = 0;
+    bool m_has_disconnected_slots = false;
+};
+
+} // namespace signal_slot